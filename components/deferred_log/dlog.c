@@ -0,0 +1,319 @@
+#include "dlog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "dlog";
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static dlog_site_t *s_sites = NULL;
+static uint16_t s_num_sites = 0;
+
+/* Totals */
+static uint32_t s_calls = 0;
+static uint64_t s_cycles = 0;
+static uint32_t s_messages = 0;
+static uint32_t s_dropped = 0;
+
+#if CONFIG_DLOG_DEFERRED
+#define DLOG_MODE "deferred"
+#else
+#define DLOG_MODE "immediate"
+#endif
+
+/*── Site registration and sampling ──*/
+
+/* Index of the first %s conversion in fmt, or -1 */
+static int8_t find_first_string_arg(const char *fmt)
+{
+    int8_t index = 0;
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') continue;
+        p++;
+        if (*p == '%') continue;
+        /* Skip flags, width, precision and length modifiers */
+        while (*p && strchr("-+ #0123456789.hlLzjt", *p)) p++;
+        if (*p == 's') return index;
+        if (!*p) break;
+        index++;
+    }
+    return -1;
+}
+
+static void register_site(dlog_site_t *site, const char *tag)
+{
+    portENTER_CRITICAL(&s_mux);
+    if (!site->registered) {
+        site->tag = tag;
+        site->str_arg = find_first_string_arg(site->fmt);
+        site->id = s_num_sites++;
+        site->next = s_sites;
+        s_sites = site;
+        site->registered = true;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+/* Register on first use, count the call and apply sampling (true = keep) */
+static inline bool site_enter(dlog_site_t *site, const char *tag)
+{
+    if (!site->registered) {
+        register_site(site, tag);
+    }
+    site->calls++;
+    if (site->sample_every > 1 && (site->sample_count++ % site->sample_every) != 0) {
+        site->sampled_out++;
+        return false;
+    }
+    return true;
+}
+
+void dlog_account(dlog_site_t *site, uint32_t start_cycles)
+{
+    uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+    portENTER_CRITICAL(&s_mux);
+    s_calls++;
+    s_cycles += cycles;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+bool dlog_sample(dlog_site_t *site, const char *tag)
+{
+    return site_enter(site, tag);
+}
+
+void dlog_count_message(void)
+{
+    s_messages++;
+}
+
+bool dlog_set_sampling(uint16_t site_id, uint16_t every)
+{
+    bool found = false;
+    portENTER_CRITICAL(&s_mux);
+    for (dlog_site_t *site = s_sites; site; site = site->next) {
+        if (site->id == site_id) {
+            site->sample_every = every;
+            site->sample_count = 0;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+    return found;
+}
+
+void dlog_log_stats(void)
+{
+    uint32_t calls = s_calls;
+    uint64_t cycles = s_cycles;
+    uint32_t messages = s_messages;
+
+    ESP_LOGI(TAG, "%s: %lu calls, %lu cycles/call, %lu cycles/message (%lu messages), %lu dropped",
+             DLOG_MODE,
+             (unsigned long)calls,
+             (unsigned long)(calls ? cycles / calls : 0),
+             (unsigned long)(messages ? cycles / messages : 0),
+             (unsigned long)messages, (unsigned long)s_dropped);
+
+    for (dlog_site_t *site = s_sites; site; site = site->next) {
+        ESP_LOGI(TAG, "  site %u [%s] every=%u calls=%lu sampled_out=%lu \"%s\"",
+                 site->id, site->tag, site->sample_every ? site->sample_every : 1,
+                 (unsigned long)site->calls, (unsigned long)site->sampled_out, site->fmt);
+    }
+}
+
+#if CONFIG_DLOG_DEFERRED
+
+/*── Ring buffer ──*/
+
+typedef struct {
+    const dlog_site_t *site;
+    uint32_t timestamp;             /* esp_log_timestamp() at the call */
+    uint8_t nargs;
+    char str[DLOG_STR_LEN];         /* Copy of the first %s argument */
+    uint64_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+static dlog_record_t s_ring[CONFIG_DLOG_RING_SIZE];
+static uint32_t s_head = 0;         /* Next record to write */
+static uint32_t s_tail = 0;         /* Next record to format */
+
+void dlog_write(dlog_site_t *site, const char *tag, const uint64_t *args, uint8_t nargs, uint32_t start_cycles)
+{
+    if (site_enter(site, tag)) {
+        uint32_t timestamp = esp_log_timestamp();
+
+        portENTER_CRITICAL_SAFE(&s_mux);
+        if (s_head - s_tail >= CONFIG_DLOG_RING_SIZE) {
+            s_dropped++;
+        } else {
+            dlog_record_t *rec = &s_ring[s_head++ % CONFIG_DLOG_RING_SIZE];
+            rec->site = site;
+            rec->timestamp = timestamp;
+            rec->nargs = nargs;
+            memcpy(rec->args, args, nargs * sizeof(uint64_t));
+            if (site->str_arg >= 0 && site->str_arg < nargs) {
+                const char *s = (const char *)(uintptr_t)args[site->str_arg];
+                strlcpy(rec->str, s ? s : "(null)", sizeof(rec->str));
+            }
+        }
+        portEXIT_CRITICAL_SAFE(&s_mux);
+    }
+
+    dlog_account(site, start_cycles);
+}
+
+/*── Expansion ──*/
+
+/* Format one record: walk the format and print each conversion with its typed argument */
+static void format_record(const dlog_record_t *rec, char *out, size_t out_len)
+{
+    const char *fmt = rec->site->fmt;
+    size_t pos = 0;
+    uint8_t arg = 0;
+
+    for (const char *p = fmt; *p && pos < out_len - 1; ) {
+        if (*p != '%') {
+            out[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        /* Copy the spec without length modifiers, remember if it was 64-bit */
+        char spec[16];
+        size_t n = 0;
+        int longs = 0;
+        spec[n++] = *p++;
+        while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 4) spec[n++] = *p++;
+        while (*p && strchr("hlLzjt", *p)) { longs += (*p == 'l' || *p == 'j'); p++; }
+        char conv = *p ? *p++ : '\0';
+
+        uint64_t v = arg < rec->nargs ? rec->args[arg] : 0;
+        int written = 0;
+        size_t room = out_len - pos;
+        switch (conv) {
+            case 'd': case 'i':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, longs >= 2 ? (long long)v : (long long)(int32_t)v);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, longs >= 2 ? (unsigned long long)v : (unsigned long long)(uint32_t)v);
+                break;
+            case 'c':
+                spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, (int)v);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                union { uint64_t u; double d; } x = { .u = v };
+                spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, x.d);
+                break;
+            }
+            case 's': {
+                const char *s = (arg == rec->site->str_arg) ? rec->str : (const char *)(uintptr_t)v;
+                spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, s ? s : "(null)");
+                break;
+            }
+            case 'p':
+                spec[n++] = conv; spec[n] = '\0';
+                written = snprintf(out + pos, room, spec, (void *)(uintptr_t)v);
+                break;
+            default:
+                written = snprintf(out + pos, room, "<?%c>", conv ? conv : ' ');
+                break;
+        }
+        arg++;
+        if (written > 0) {
+            pos += ((size_t)written < room) ? (size_t)written : room - 1;
+        }
+    }
+    out[pos] = '\0';
+}
+
+void dlog_flush(void)
+{
+    static const char level_chars[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+    char line[160];
+    dlog_record_t rec;
+
+    for (;;) {
+        portENTER_CRITICAL(&s_mux);
+        if (s_tail == s_head) {
+            portEXIT_CRITICAL(&s_mux);
+            break;
+        }
+        rec = s_ring[s_tail++ % CONFIG_DLOG_RING_SIZE];
+        portEXIT_CRITICAL(&s_mux);
+
+        format_record(&rec, line, sizeof(line));
+        esp_log_level_t level = (esp_log_level_t)rec.site->level;
+        esp_log_write(level, rec.site->tag, "%c (%lu) %s: %s\n",
+                      level_chars[level < sizeof(level_chars) ? level : 0],
+                      (unsigned long)rec.timestamp, rec.site->tag, line);
+    }
+}
+
+static void dlog_task(void *arg)
+{
+    TickType_t last_stats = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_FLUSH_INTERVAL_MS));
+        dlog_flush();
+
+        if (CONFIG_DLOG_STATS_INTERVAL_S > 0 &&
+            xTaskGetTickCount() - last_stats >= pdMS_TO_TICKS(CONFIG_DLOG_STATS_INTERVAL_S * 1000)) {
+            last_stats = xTaskGetTickCount();
+            dlog_log_stats();
+        }
+    }
+}
+
+void dlog_init(void)
+{
+    static bool started = false;
+    if (started) return;
+    started = true;
+    xTaskCreate(dlog_task, "dlog", 3072, NULL, CONFIG_DLOG_TASK_PRIORITY, NULL);
+}
+
+#else
+
+void dlog_write(dlog_site_t *site, const char *tag, const uint64_t *args, uint8_t nargs, uint32_t start_cycles)
+{
+    /* Not used in immediate mode (the macros call ESP_LOG directly) */
+    dlog_account(site, start_cycles);
+}
+
+void dlog_flush(void)
+{
+}
+
+static void dlog_stats_task(void *arg)
+{
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_STATS_INTERVAL_S * 1000));
+        dlog_log_stats();
+    }
+}
+
+void dlog_init(void)
+{
+    static bool started = false;
+    if (started || CONFIG_DLOG_STATS_INTERVAL_S <= 0) return;
+    started = true;
+    xTaskCreate(dlog_stats_task, "dlog", 2048, NULL, 1, NULL);
+}
+
+#endif
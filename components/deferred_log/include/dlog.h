@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Deferred logging for hot paths.
+ *
+ * DLOGx(tag, fmt, ...) behaves like ESP_LOGx, but the call site only stores a
+ * pointer to its static site descriptor plus up to DLOG_MAX_ARGS raw 64-bit
+ * arguments in a ring buffer. Formatting happens later in a low-priority task.
+ *
+ * Arguments: integers, enums, bool, float/double and pointers. The first %s
+ * argument is copied into the record (up to DLOG_STR_LEN - 1 chars); any
+ * further %s arguments must point to static storage (literals,
+ * esp_err_to_name()). '*' width/precision is not supported.
+ *
+ * DLOGx_SAMPLED(tag, every, fmt, ...) only records every Nth call of that
+ * site; dlog_set_sampling() changes the rate at runtime by site id (ids are
+ * listed by dlog_log_stats()).
+ */
+
+#define DLOG_MAX_ARGS   6
+#define DLOG_STR_LEN    24
+
+typedef struct dlog_site {
+    const char *tag;                /* Set on first use (TAG is not a C constant expression) */
+    const char *fmt;
+    uint8_t level;                  /* esp_log_level_t */
+    uint16_t sample_every;          /* 0/1 = every call */
+    /* Filled in on first use */
+    bool registered;
+    int8_t str_arg;                 /* Index of first %s argument, -1 = none */
+    uint16_t id;
+    uint16_t sample_count;
+    uint32_t calls;
+    uint32_t sampled_out;
+    struct dlog_site *next;
+} dlog_site_t;
+
+/* Start the flush/stats task (records logged earlier are kept until then) */
+void dlog_init(void);
+
+/* Format and print all pending records now (e.g. before deep sleep) */
+void dlog_flush(void);
+
+/* Record a call (used by the DLOG* macros in deferred mode) */
+void dlog_write(dlog_site_t *site, const char *tag, const uint64_t *args, uint8_t nargs, uint32_t start_cycles);
+
+/* Register the site and apply sampling, returns true if the call should be logged (immediate mode) */
+bool dlog_sample(dlog_site_t *site, const char *tag);
+
+/* Add the cycles spent since start_cycles to the totals (immediate mode) */
+void dlog_account(dlog_site_t *site, uint32_t start_cycles);
+
+/* Count one processed message, so stats can report logging cycles per message */
+void dlog_count_message(void);
+
+/* Change a site's sampling rate (1 = every call); returns false if id unknown */
+bool dlog_set_sampling(uint16_t site_id, uint16_t every);
+
+/* Log totals and per-site counters */
+void dlog_log_stats(void);
+
+/*── Argument packing ──*/
+
+static inline uint64_t dlog_arg_double(double v) { union { double d; uint64_t u; } x = { .d = v }; return x.u; }
+static inline uint64_t dlog_arg_ptr(const void *p) { return (uint64_t)(uintptr_t)p; }
+static inline uint64_t dlog_arg_int(long long v) { return (uint64_t)v; }
+static inline uint64_t dlog_arg_uint(unsigned long long v) { return (uint64_t)v; }
+
+#ifdef __cplusplus
+}
+
+#include <type_traits>
+
+static inline uint64_t dlog_arg(double v) { return dlog_arg_double(v); }
+static inline uint64_t dlog_arg(const char *s) { return dlog_arg_ptr(s); }
+static inline uint64_t dlog_arg(char *s) { return dlog_arg_ptr(s); }
+static inline uint64_t dlog_arg(const void *p) { return dlog_arg_ptr(p); }
+static inline uint64_t dlog_arg(void *p) { return dlog_arg_ptr(p); }
+template <typename T>
+static inline uint64_t dlog_arg(T v)
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_floating_point<T>::value,
+                  "DLOG arguments must be integers, enums, floats or pointers");
+    if constexpr (std::is_floating_point<T>::value) {
+        return dlog_arg_double(v);
+    } else if constexpr (std::is_signed<T>::value) {
+        return dlog_arg_int(static_cast<long long>(v));
+    } else {
+        return dlog_arg_uint(static_cast<unsigned long long>(v));
+    }
+}
+#define DLOG_ARG(x) dlog_arg(x)
+
+#else
+
+#define DLOG_ARG(x) _Generic((x),                           \
+        float: dlog_arg_double, double: dlog_arg_double,    \
+        char *: dlog_arg_ptr, const char *: dlog_arg_ptr,   \
+        void *: dlog_arg_ptr, const void *: dlog_arg_ptr,   \
+        signed char: dlog_arg_int, short: dlog_arg_int,     \
+        int: dlog_arg_int, long: dlog_arg_int,              \
+        long long: dlog_arg_int,                            \
+        default: dlog_arg_uint)(x)
+
+#endif
+
+/*── Call-site macros ──*/
+
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_MAP_0()
+#define DLOG_MAP_1(a)                   DLOG_ARG(a)
+#define DLOG_MAP_2(a, b)                DLOG_ARG(a), DLOG_ARG(b)
+#define DLOG_MAP_3(a, b, c)             DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c)
+#define DLOG_MAP_4(a, b, c, d)          DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d)
+#define DLOG_MAP_5(a, b, c, d, e)       DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e)
+#define DLOG_MAP_6(a, b, c, d, e, f)    DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d), DLOG_ARG(e), DLOG_ARG(f)
+#define DLOG_MAP(...) DLOG_CAT(DLOG_MAP_, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#if CONFIG_DLOG_DEFERRED
+
+#define DLOG_LEVEL_SAMPLED(level, tag, every, format, ...) do {                             \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                                   \
+            static dlog_site_t _dlog_site = { NULL, (format), (level), (every) };           \
+            uint32_t _dlog_start = esp_cpu_get_cycle_count();                               \
+            const uint64_t _dlog_args[DLOG_MAX_ARGS + 1] = { 0, DLOG_MAP(__VA_ARGS__) };    \
+            dlog_write(&_dlog_site, (tag), &_dlog_args[1], DLOG_NARGS(__VA_ARGS__),         \
+                       _dlog_start);                                                        \
+        }                                                                                   \
+    } while (0)
+
+#else
+
+#define DLOG_LEVEL_SAMPLED(level, tag, every, format, ...) do {                             \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                                   \
+            static dlog_site_t _dlog_site = { NULL, (format), (level), (every) };           \
+            uint32_t _dlog_start = esp_cpu_get_cycle_count();                               \
+            if (dlog_sample(&_dlog_site, (tag))) {                                          \
+                ESP_LOG_LEVEL((level), (tag), format, ##__VA_ARGS__);                       \
+            }                                                                               \
+            dlog_account(&_dlog_site, _dlog_start);                                         \
+        }                                                                                   \
+    } while (0)
+
+#endif
+
+#define DLOG_LEVEL(level, tag, format, ...) DLOG_LEVEL_SAMPLED(level, tag, 1, format, ##__VA_ARGS__)
+
+#define DLOGE(tag, format, ...) DLOG_LEVEL(ESP_LOG_ERROR,   tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_LEVEL(ESP_LOG_WARN,    tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_LEVEL(ESP_LOG_INFO,    tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_LEVEL(ESP_LOG_DEBUG,   tag, format, ##__VA_ARGS__)
+#define DLOGV(tag, format, ...) DLOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#define DLOGI_SAMPLED(tag, every, format, ...) DLOG_LEVEL_SAMPLED(ESP_LOG_INFO, tag, every, format, ##__VA_ARGS__)
+#define DLOGD_SAMPLED(tag, every, format, ...) DLOG_LEVEL_SAMPLED(ESP_LOG_DEBUG, tag, every, format, ##__VA_ARGS__)
@@ -36,3 +36,19 @@ void device_name_get(char *buf, size_t len) {
 
     snprintf(buf, len, "%s-%s-%04x", adj, noun, suffix);
 }
+
+uint32_t device_name_seed(void) {
+    uint8_t mac[6];
+    esp_efuse_mac_get_default(mac);
+
+    /* FNV-1a over all 6 bytes, then a final mix so nearby MACs spread apart */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash ^= mac[i];
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 /**
  * Get deterministic device name based on chip ID.
@@ -13,3 +14,10 @@
  * @param len Buffer size (recommend 32+ bytes)
  */
 void device_name_get(char *buf, size_t len);
+
+/**
+ * Get a deterministic per-device 32-bit value derived from the full MAC.
+ * Use it to spread timing (jitter) across devices without a random source;
+ * the same device always returns the same value.
+ */
+uint32_t device_name_seed(void);
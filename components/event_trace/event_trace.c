@@ -0,0 +1,130 @@
+#include "event_trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "trace";
+
+#if CONFIG_EVENT_TRACE_ENABLE
+
+static const char *s_id_names[TRACE_ID_MAX] = {
+    [TRACE_ID_NONE]               = "none",
+    [TRACE_ID_TC_RECEIVE]         = "tc_receive",
+    [TRACE_ID_TC_SEND]            = "tc_send",
+    [TRACE_ID_BRIDGE_REPORT]      = "bridge_on_report",
+    [TRACE_ID_BRIDGE_NVS_SAVE]    = "bridge_nvs_save",
+    [TRACE_ID_MATTER_ATTR_UPDATE] = "matter_attr_update",
+    [TRACE_ID_MATTER_WRITE]       = "matter_write",
+    [TRACE_ID_BRIDGE_DEVICES]     = "bridge_devices",
+};
+
+#define RING_SIZE CONFIG_EVENT_TRACE_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+
+_Static_assert((RING_SIZE & RING_MASK) == 0, "EVENT_TRACE_RING_SIZE must be a power of two");
+
+typedef struct {
+    uint32_t ts_us;     /* Lower 32 bits of esp_timer time (wraps every ~71 min) */
+    uint16_t id;
+    uint8_t type;
+    uint8_t reserved;
+    uint32_t arg;
+    uint32_t tid;       /* Recording task (handle bits, 0 in ISR) */
+} trace_event_t;
+
+_Static_assert(sizeof(trace_event_t) == 16, "trace_event_t should stay 16 bytes");
+
+typedef struct {
+    trace_event_t events[RING_SIZE];
+    uint32_t head;      /* Total events written; slot = head & RING_MASK */
+} trace_ring_t;
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+static volatile bool s_paused = false;
+
+void IRAM_ATTR trace_record(trace_type_t type, uint16_t id, uint32_t arg)
+{
+    if (s_paused) {
+        return;
+    }
+
+    /* Masking interrupts pins us to this core and makes the slot claim atomic */
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    trace_ring_t *ring = &s_rings[xPortGetCoreID()];
+    trace_event_t *ev = &ring->events[ring->head++ & RING_MASK];
+    ev->ts_us = (uint32_t)esp_timer_get_time();
+    ev->id = id;
+    ev->type = (uint8_t)type;
+    ev->arg = arg;
+    ev->tid = xPortInIsrContext() ? 0 : (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+static void dump_task_names(void)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(count * sizeof(TaskStatus_t));
+    if (!tasks) {
+        return;
+    }
+    count = uxTaskGetSystemState(tasks, count, NULL);
+    for (UBaseType_t i = 0; i < count; i++) {
+        ESP_LOGI(TAG, "TRACE-TASK %lu %s",
+                 (unsigned long)(uintptr_t)tasks[i].xHandle, tasks[i].pcTaskName);
+    }
+    free(tasks);
+}
+
+void trace_dump(void)
+{
+    s_paused = true;
+
+    ESP_LOGI(TAG, "TRACE-START %d %lld", portNUM_PROCESSORS, (long long)esp_timer_get_time());
+    for (int id = 0; id < TRACE_ID_MAX; id++) {
+        ESP_LOGI(TAG, "TRACE-NAME %d %s", id, s_id_names[id]);
+    }
+    dump_task_names();
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        const trace_ring_t *ring = &s_rings[core];
+        uint32_t head = ring->head;
+        uint32_t count = head < RING_SIZE ? head : RING_SIZE;
+        for (uint32_t i = head - count; i != head; i++) {
+            const trace_event_t *ev = &ring->events[i & RING_MASK];
+            ESP_LOGI(TAG, "TRACE %d %lu %u %u %lu %lu", core,
+                     (unsigned long)ev->ts_us, ev->type, ev->id,
+                     (unsigned long)ev->arg, (unsigned long)ev->tid);
+        }
+    }
+    ESP_LOGI(TAG, "TRACE-STOP");
+
+    s_paused = false;
+}
+
+void trace_clear(void)
+{
+    s_paused = true;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        s_rings[core].head = 0;
+    }
+    s_paused = false;
+}
+
+#else
+
+void trace_dump(void)
+{
+    ESP_LOGW(TAG, "Tracing disabled (CONFIG_EVENT_TRACE_ENABLE=n)");
+}
+
+void trace_clear(void)
+{
+}
+
+#endif
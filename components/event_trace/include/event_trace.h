@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Lightweight event tracing.
+ *
+ * Events are 16-byte binary records written into a per-core ring buffer
+ * (oldest events are overwritten). Recording takes a timestamp and a few
+ * stores with interrupts masked on the local core - no locks, no formatting.
+ *
+ * trace_dump() prints the buffers as "TRACE ..." lines; feed a serial log to
+ * tools/trace_to_perfetto.py to get a trace for ui.perfetto.dev.
+ */
+
+typedef enum {
+    TRACE_TYPE_BEGIN,
+    TRACE_TYPE_END,
+    TRACE_TYPE_INSTANT,
+    TRACE_TYPE_COUNTER,
+} trace_type_t;
+
+/* Event ids (names are listed in event_trace.c, keep both in sync) */
+typedef enum {
+    TRACE_ID_NONE = 0,
+    TRACE_ID_TC_RECEIVE,            /* thread_comms handle_receive */
+    TRACE_ID_TC_SEND,               /* thread_comms send_message, arg = msg_id */
+    TRACE_ID_BRIDGE_REPORT,         /* BridgeState::on_report */
+    TRACE_ID_BRIDGE_NVS_SAVE,       /* bridge_nvs_save_device, end arg = bytes written */
+    TRACE_ID_MATTER_ATTR_UPDATE,    /* attribute::update, arg = endpoint id */
+    TRACE_ID_MATTER_WRITE,          /* Matter controller write, arg = endpoint id */
+    TRACE_ID_BRIDGE_DEVICES,        /* Counter: known bridge devices */
+    TRACE_ID_MAX,
+} trace_id_t;
+
+#if CONFIG_EVENT_TRACE_ENABLE
+
+void trace_record(trace_type_t type, uint16_t id, uint32_t arg);
+
+#define TRACE_BEGIN(id, arg)        trace_record(TRACE_TYPE_BEGIN, (id), (arg))
+#define TRACE_END(id, arg)          trace_record(TRACE_TYPE_END, (id), (arg))
+#define TRACE_INSTANT(id, arg)      trace_record(TRACE_TYPE_INSTANT, (id), (arg))
+#define TRACE_COUNTER(id, value)    trace_record(TRACE_TYPE_COUNTER, (id), (value))
+
+#else
+
+#define TRACE_BEGIN(id, arg)        do { } while (0)
+#define TRACE_END(id, arg)          do { } while (0)
+#define TRACE_INSTANT(id, arg)      do { } while (0)
+#define TRACE_COUNTER(id, value)    do { } while (0)
+
+#endif
+
+/* Print all buffered events to the console (no-op when tracing is disabled) */
+void trace_dump(void);
+
+/* Drop all buffered events */
+void trace_clear(void);
+
+#ifdef __cplusplus
+}
+
+/* RAII begin/end pair; set_arg() changes the payload of the end event */
+class TraceScope {
+public:
+    explicit TraceScope(uint16_t id, uint32_t arg = 0) : id_(id), arg_(arg) { TRACE_BEGIN(id_, arg_); }
+    ~TraceScope() { TRACE_END(id_, arg_); }
+    void set_arg(uint32_t arg) { arg_ = arg; }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+private:
+    uint16_t id_;
+    uint32_t arg_;
+};
+#endif
@@ -4,13 +4,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define PM_MAX_WAKE_GPIOS 4
+#define PM_DEFAULT_DEBOUNCE_MS 30
+#define PM_MAX_BOOSTS 8
+
+/**
+ * Debounced wake GPIO events.
+ */
+typedef enum {
+    PM_WAKE_EVENT_PRESS,    /* GPIO became active */
+    PM_WAKE_EVENT_RELEASE,  /* GPIO became inactive, held_ms = total press duration */
+    PM_WAKE_EVENT_HELD,     /* GPIO still active after another hold_ms, held_ms = time held so far */
+} pm_wake_event_t;
 
 /**
- * Callback invoked when a wake GPIO is triggered.
+ * Callback invoked when a wake GPIO changes state.
  * Called from task context (not ISR).
  */
-typedef void (*pm_wake_cb_t)(gpio_num_t gpio);
+typedef void (*pm_wake_cb_t)(gpio_num_t gpio, pm_wake_event_t event, uint32_t held_ms);
 
 /**
  * Wake GPIO configuration.
@@ -18,6 +33,7 @@ typedef void (*pm_wake_cb_t)(gpio_num_t gpio);
 typedef struct {
     gpio_num_t gpio;
     bool active_low;      /* true = trigger on low (pull-up), false = trigger on high (pull-down) */
+    uint32_t hold_ms;     /* Report PM_WAKE_EVENT_HELD every hold_ms while active (0 = never) */
 } pm_wake_gpio_t;
 
 typedef struct {
@@ -26,6 +42,7 @@ typedef struct {
     uint32_t stats_interval_ms;
     pm_wake_cb_t wake_cb;  /* Optional callback for wake GPIO events */
     bool light_sleep_enable;
+    uint32_t debounce_ms;  /* Settle time after an edge (0 = PM_DEFAULT_DEBOUNCE_MS) */
 } pm_config_t;
 
 void pm_init(const pm_config_t *config);
@@ -39,3 +56,37 @@ void pm_deep_sleep_for(uint32_t sleep_ms) __attribute__((noreturn));
 
 /* Restart the device */
 void pm_restart(void) __attribute__((noreturn));
+
+/**
+ * CPU frequency boost (holds an ESP_PM_CPU_FREQ_MAX lock while active).
+ *
+ * Wrap short CPU-bound bursts (protobuf encode, frame security, MLE) so they
+ * run at max frequency instead of XTAL, shortening the awake window.
+ * Begin/end pairs may nest and may be used from any task.
+ * Boosting is skipped (stats still collected) with CONFIG_PM_BOOST_ENABLE=n.
+ */
+typedef struct pm_boost *pm_boost_t;
+
+/* Create a named boost handle (returns NULL once PM_MAX_BOOSTS are in use) */
+pm_boost_t pm_boost_create(const char *name);
+
+void pm_boost_begin(pm_boost_t boost);
+void pm_boost_end(pm_boost_t boost);
+
+/* Log per-boost burst count and time spent boosted */
+void pm_log_boost_stats(void);
+
+#ifdef __cplusplus
+}
+
+/* RAII scope for pm_boost_begin/pm_boost_end */
+class PmBoostScope {
+public:
+    explicit PmBoostScope(pm_boost_t boost) : boost_(boost) { pm_boost_begin(boost_); }
+    ~PmBoostScope() { pm_boost_end(boost_); }
+    PmBoostScope(const PmBoostScope&) = delete;
+    PmBoostScope& operator=(const PmBoostScope&) = delete;
+private:
+    pm_boost_t boost_;
+};
+#endif
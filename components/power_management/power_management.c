@@ -3,6 +3,8 @@
 #include "esp_pm.h"
 #include "esp_sleep.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "hal/gpio_ll.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -13,11 +15,44 @@ static const char *TAG = "pm";
 static uint32_t stats_interval_ms = 10000;
 static pm_wake_cb_t g_wake_cb = NULL;
 static QueueHandle_t g_wake_queue = NULL;
+static int64_t g_debounce_us = PM_DEFAULT_DEBOUNCE_MS * 1000;
 
 /* Store wake GPIO config for deep sleep */
 static pm_wake_gpio_t g_wake_gpios[PM_MAX_WAKE_GPIOS];
 static uint8_t g_num_wake_gpios = 0;
 
+/* Edge captured by the ISR */
+typedef struct {
+    uint8_t index;        /* Into g_wake_state */
+    int64_t time_us;
+} pm_edge_t;
+
+/* Per-GPIO debounce / long-press state */
+typedef struct {
+    volatile bool armed_high;   /* Level the interrupt currently fires on (ISR owned) */
+    bool settling;              /* Edge seen, waiting for the level to settle */
+    bool pressed;               /* Debounced state */
+    int64_t edge_us;            /* First edge of the current burst */
+    int64_t press_us;           /* Start of the current press */
+    uint32_t holds;             /* HELD events reported for the current press */
+} pm_wake_state_t;
+
+static pm_wake_state_t g_wake_state[PM_MAX_WAKE_GPIOS];
+
+/* CPU frequency boosts */
+struct pm_boost {
+    const char *name;
+    esp_pm_lock_handle_t lock;  /* NULL if boosting is disabled or PM unavailable */
+    uint32_t depth;             /* Nesting depth across all callers */
+    uint32_t bursts;            /* Outermost begin/end pairs */
+    int64_t start_us;
+    int64_t total_us;
+};
+
+static struct pm_boost g_boosts[PM_MAX_BOOSTS];
+static uint8_t g_num_boosts = 0;
+static portMUX_TYPE g_boost_mux = portMUX_INITIALIZER_UNLOCKED;
+
 static void pm_stats_task(void *arg) {
     TickType_t last_wake = xTaskGetTickCount();
     for (;;) {
@@ -26,20 +61,104 @@ static void pm_stats_task(void *arg) {
     }
 }
 
+static inline gpio_int_type_t level_intr(bool high) {
+    return high ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL;
+}
+
+static bool wake_gpio_active(int i) {
+    int level = gpio_get_level(g_wake_gpios[i].gpio);
+    return g_wake_gpios[i].active_low ? (level == 0) : (level == 1);
+}
+
+/*
+ * GPIO light-sleep wake only works with level triggers, and gpio_wakeup_enable()
+ * shares the pin's interrupt type. Instead of ANYEDGE we arm the opposite level
+ * on every interrupt: each transition fires exactly once, and whatever level is
+ * armed also serves as the light-sleep wake condition.
+ */
 static void IRAM_ATTR gpio_isr_handler(void *arg) {
-    gpio_num_t gpio = (gpio_num_t)(uintptr_t)arg;
-    xQueueSendFromISR(g_wake_queue, &gpio, NULL);
+    uint8_t index = (uint8_t)(uintptr_t)arg;
+    pm_wake_state_t *st = &g_wake_state[index];
+
+    st->armed_high = !st->armed_high;
+    gpio_ll_set_intr_type(GPIO_LL_GET_HW(GPIO_PORT_0), g_wake_gpios[index].gpio, level_intr(st->armed_high));
+
+    pm_edge_t edge = { .index = index, .time_us = esp_timer_get_time() };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(g_wake_queue, &edge, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+static void emit_wake_event(int i, pm_wake_event_t event, uint32_t held_ms) {
+    static const char *names[] = { "pressed", "released", "held" };
+    ESP_LOGI(TAG, "Wake GPIO%d %s (%lu ms)", g_wake_gpios[i].gpio, names[event], (unsigned long)held_ms);
+    if (g_wake_cb) {
+        g_wake_cb(g_wake_gpios[i].gpio, event, held_ms);
+    }
+}
+
+/* Advance one GPIO's state machine, returns µs until it next needs attention (-1 = idle) */
+static int64_t wake_gpio_step(int i, int64_t now) {
+    pm_wake_state_t *st = &g_wake_state[i];
+    uint32_t hold_ms = g_wake_gpios[i].hold_ms;
+
+    if (st->settling && now - st->edge_us >= g_debounce_us) {
+        st->settling = false;
+        bool active = wake_gpio_active(i);
+        if (active && !st->pressed) {
+            st->pressed = true;
+            st->press_us = st->edge_us;
+            st->holds = 0;
+            emit_wake_event(i, PM_WAKE_EVENT_PRESS, 0);
+        } else if (!active && st->pressed) {
+            st->pressed = false;
+            emit_wake_event(i, PM_WAKE_EVENT_RELEASE, (uint32_t)((st->edge_us - st->press_us) / 1000));
+        }
+        /* Otherwise it bounced back to where it was - nothing to report */
+    }
+
+    if (st->pressed && hold_ms > 0) {
+        int64_t next_hold_us = st->press_us + (int64_t)(st->holds + 1) * hold_ms * 1000;
+        if (now >= next_hold_us) {
+            st->holds++;
+            emit_wake_event(i, PM_WAKE_EVENT_HELD, st->holds * hold_ms);
+            next_hold_us += (int64_t)hold_ms * 1000;
+        }
+        if (!st->settling) {
+            return next_hold_us - now;
+        }
+    }
+
+    if (st->settling) {
+        return st->edge_us + g_debounce_us - now;
+    }
+    return -1;
 }
 
 static void pm_wake_task(void *arg) {
-    gpio_num_t gpio;
+    TickType_t timeout = portMAX_DELAY;
+    pm_edge_t edge;
     for (;;) {
-        if (xQueueReceive(g_wake_queue, &gpio, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGI(TAG, "Wake GPIO%d triggered", gpio);
-            if (g_wake_cb) {
-                g_wake_cb(gpio);
+        if (xQueueReceive(g_wake_queue, &edge, timeout) == pdTRUE) {
+            pm_wake_state_t *st = &g_wake_state[edge.index];
+            if (!st->settling) {
+                st->settling = true;
+                st->edge_us = edge.time_us;
+            }
+        }
+
+        /* Block until the nearest debounce or hold deadline, or forever if all GPIOs are idle */
+        int64_t now = esp_timer_get_time();
+        int64_t next_us = -1;
+        for (int i = 0; i < g_num_wake_gpios; i++) {
+            int64_t due_us = wake_gpio_step(i, now);
+            if (due_us >= 0 && (next_us < 0 || due_us < next_us)) {
+                next_us = due_us;
             }
         }
+        timeout = next_us < 0 ? portMAX_DELAY : pdMS_TO_TICKS((next_us + 999) / 1000) + 1;
     }
 }
 
@@ -48,48 +167,29 @@ void pm_init(const pm_config_t *config) {
     if (config->stats_interval_ms > 0) {
         stats_interval_ms = config->stats_interval_ms;
     }
+    if (config->debounce_ms > 0) {
+        g_debounce_us = (int64_t)config->debounce_ms * 1000;
+    }
 
     /* Store callback */
     g_wake_cb = config->wake_cb;
 
     /* Store wake GPIO config for deep sleep */
-    g_num_wake_gpios = config->num_wake_gpios;
-    for (int i = 0; i < config->num_wake_gpios && i < PM_MAX_WAKE_GPIOS; i++) {
+    g_num_wake_gpios = config->num_wake_gpios < PM_MAX_WAKE_GPIOS ? config->num_wake_gpios : PM_MAX_WAKE_GPIOS;
+    for (int i = 0; i < g_num_wake_gpios; i++) {
         g_wake_gpios[i] = config->wake_gpios[i];
     }
 
-    /* Check if we woke from deep sleep via GPIO */
-    esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
-    if ((wakeup_cause == ESP_SLEEP_WAKEUP_EXT1 || wakeup_cause == ESP_SLEEP_WAKEUP_GPIO)
-        && g_wake_cb != NULL) {
-        /* Find which configured GPIO is currently active */
-        for (int i = 0; i < g_num_wake_gpios; i++) {
-            gpio_num_t gpio = g_wake_gpios[i].gpio;
-            int level = gpio_get_level(gpio);
-            bool is_active = g_wake_gpios[i].active_low ? (level == 0) : (level == 1);
-            if (is_active) {
-                ESP_LOGI(TAG, "Woke from deep sleep via GPIO%d", gpio);
-                g_wake_cb(gpio);
-                break;
-            }
-        }
-    }
-
     /* Configure GPIO wake sources */
-    if (config->num_wake_gpios > 0) {
-        /* Create queue and task for handling wake events */
-        g_wake_queue = xQueueCreate(4, sizeof(gpio_num_t));
-        xTaskCreate(pm_wake_task, "pm_wake", 2048, NULL, 10, NULL);
+    if (g_num_wake_gpios > 0) {
+        g_wake_queue = xQueueCreate(8, sizeof(pm_edge_t));
 
         /* Install GPIO ISR service */
         gpio_install_isr_service(0);
 
-        for (int i = 0; i < config->num_wake_gpios; i++) {
-            const pm_wake_gpio_t *wake_gpio = &config->wake_gpios[i];
+        for (int i = 0; i < g_num_wake_gpios; i++) {
+            const pm_wake_gpio_t *wake_gpio = &g_wake_gpios[i];
             gpio_num_t gpio = wake_gpio->gpio;
-            gpio_int_type_t intr_type = wake_gpio->active_low
-                ? GPIO_INTR_LOW_LEVEL
-                : GPIO_INTR_HIGH_LEVEL;
 
             /* Configure GPIO as input with appropriate pull */
             gpio_config_t io_cfg = {
@@ -97,15 +197,22 @@ void pm_init(const pm_config_t *config) {
                 .mode = GPIO_MODE_INPUT,
                 .pull_up_en = wake_gpio->active_low ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
                 .pull_down_en = wake_gpio->active_low ? GPIO_PULLDOWN_DISABLE : GPIO_PULLDOWN_ENABLE,
-                .intr_type = intr_type,
+                .intr_type = GPIO_INTR_DISABLE,
             };
             gpio_config(&io_cfg);
 
+            /* Arm for the next transition from the current level */
+            pm_wake_state_t *st = &g_wake_state[i];
+            st->pressed = wake_gpio_active(i);
+            st->press_us = esp_timer_get_time();
+            st->armed_high = st->pressed ? wake_gpio->active_low : !wake_gpio->active_low;
+
             /* Add ISR handler */
-            gpio_isr_handler_add(gpio, gpio_isr_handler, (void *)(uintptr_t)gpio);
+            gpio_isr_handler_add(gpio, gpio_isr_handler, (void *)(uintptr_t)i);
 
-            /* Enable as wake source for light sleep */
-            gpio_wakeup_enable(gpio, intr_type);
+            /* Enable as wake source for light sleep (also sets the interrupt type) */
+            gpio_wakeup_enable(gpio, level_intr(st->armed_high));
+            gpio_intr_enable(gpio);
             ESP_LOGI(TAG, "GPIO%d configured as wake source (active_%s)",
                      gpio, wake_gpio->active_low ? "low" : "high");
         }
@@ -113,6 +220,24 @@ void pm_init(const pm_config_t *config) {
         esp_sleep_enable_gpio_wakeup();
     }
 
+    /* Check if we woke from deep sleep via GPIO */
+    esp_sleep_wakeup_cause_t wakeup_cause = esp_sleep_get_wakeup_cause();
+    if (wakeup_cause == ESP_SLEEP_WAKEUP_EXT1 || wakeup_cause == ESP_SLEEP_WAKEUP_GPIO) {
+        /* Report the configured GPIO that is still held as a press */
+        for (int i = 0; i < g_num_wake_gpios; i++) {
+            if (g_wake_state[i].pressed) {
+                ESP_LOGI(TAG, "Woke from deep sleep via GPIO%d", g_wake_gpios[i].gpio);
+                emit_wake_event(i, PM_WAKE_EVENT_PRESS, 0);
+                break;
+            }
+        }
+    }
+
+    /* Task handling wake events (started after the deep sleep check so it owns the state from here on) */
+    if (g_num_wake_gpios > 0) {
+        xTaskCreate(pm_wake_task, "pm_wake", 3072, NULL, 10, NULL);
+    }
+
     /* Configure power management */
     esp_pm_config_t pm_cfg = {
         .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
@@ -156,6 +281,12 @@ void pm_log_stats(void) {
         log_multiline(buf);
     }
 
+    /* Print time spent boosted (PM lock stats above show time per CPU frequency mode) */
+    if (g_num_boosts > 0) {
+        ESP_LOGI(TAG, "========== Boosts ==========");
+        pm_log_boost_stats();
+    }
+
     /* Print FreeRTOS task list */
     ESP_LOGI(TAG, "========== Tasks ==========");
     ESP_LOGI(TAG, "Name            State   Prio    Stack   Num");
@@ -188,7 +319,76 @@ static void configure_gpio_wake_for_deep_sleep(void) {
     }
 }
 
+pm_boost_t pm_boost_create(const char *name) {
+    portENTER_CRITICAL(&g_boost_mux);
+    if (g_num_boosts >= PM_MAX_BOOSTS) {
+        portEXIT_CRITICAL(&g_boost_mux);
+        ESP_LOGE(TAG, "No free boost slot for '%s'", name);
+        return NULL;
+    }
+    struct pm_boost *boost = &g_boosts[g_num_boosts++];
+    portEXIT_CRITICAL(&g_boost_mux);
+
+    boost->name = name;
+#if CONFIG_PM_BOOST_ENABLE
+    esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, name, &boost->lock);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Boost '%s' unavailable: %s", name, esp_err_to_name(err));
+        boost->lock = NULL;
+    }
+#endif
+    return boost;
+}
+
+void pm_boost_begin(pm_boost_t boost) {
+    if (!boost) return;
+
+    if (boost->lock) {
+        esp_pm_lock_acquire(boost->lock);
+    }
+
+    portENTER_CRITICAL(&g_boost_mux);
+    if (boost->depth++ == 0) {
+        boost->start_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&g_boost_mux);
+}
+
+void pm_boost_end(pm_boost_t boost) {
+    if (!boost) return;
+
+    portENTER_CRITICAL(&g_boost_mux);
+    if (boost->depth > 0 && --boost->depth == 0) {
+        boost->total_us += esp_timer_get_time() - boost->start_us;
+        boost->bursts++;
+    }
+    portEXIT_CRITICAL(&g_boost_mux);
+
+    if (boost->lock) {
+        esp_pm_lock_release(boost->lock);
+    }
+}
+
+void pm_log_boost_stats(void) {
+    for (int i = 0; i < g_num_boosts; i++) {
+        const struct pm_boost *boost = &g_boosts[i];
+        uint32_t bursts = boost->bursts;
+        int64_t total_us = boost->total_us;
+        ESP_LOGI(TAG, "Boost %-10s %s: %lu bursts, %lld us total, %lld us avg",
+                 boost->name, boost->lock ? "on " : "off",
+                 (unsigned long)bursts, (long long)total_us,
+                 bursts ? (long long)(total_us / bursts) : 0LL);
+    }
+}
+
+/* Awake-window summary for duty-cycled devices (the stats task rarely runs before sleep) */
+static void log_awake_summary(void) {
+    ESP_LOGI(TAG, "Awake for %lld ms", (long long)(esp_timer_get_time() / 1000));
+    pm_log_boost_stats();
+}
+
 void pm_deep_sleep(void) {
+    log_awake_summary();
     configure_gpio_wake_for_deep_sleep();
     ESP_LOGI(TAG, "Entering deep sleep");
     esp_deep_sleep_start();
@@ -196,6 +396,7 @@ void pm_deep_sleep(void) {
 }
 
 void pm_deep_sleep_for(uint32_t sleep_ms) {
+    log_awake_summary();
     configure_gpio_wake_for_deep_sleep();
     esp_sleep_enable_timer_wakeup((uint64_t)sleep_ms * 1000);
     ESP_LOGI(TAG, "Entering deep sleep for %lu ms", (unsigned long)sleep_ms);
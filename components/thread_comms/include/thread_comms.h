@@ -23,6 +23,8 @@ typedef struct {
     bool has_humidity;
     bool relay_state;
     bool has_relay_state;
+    uint32_t listen_ms;      /* Receive window after this report (sleepy senders) */
+    bool has_listen_ms;      /* false = sender is always listening (rx-on) */
 } thread_comms_report_t;
 
 typedef struct {
@@ -30,22 +32,70 @@ typedef struct {
     bool relay_state;        /* Desired state */
 } thread_comms_relay_cmd_t;
 
+typedef struct {
+    char device_id[32];      /* Target device */
+    uint32_t period_ms;      /* Report every period_ms */
+    uint32_t next_slot_ms;   /* Next report slot starts this long after the report this answers */
+    uint32_t slot;           /* Slot index (informational) */
+} thread_comms_schedule_t;
+
 typedef enum {
     THREAD_COMMS_MSG_REPORT,
     THREAD_COMMS_MSG_RELAY_CMD,
+    THREAD_COMMS_MSG_SCHEDULE,
 } thread_comms_msg_type_t;
 
 typedef struct {
-    uint32_t msg_id;  /* Upper 16 bits: timestamp, lower 16 bits: random */
+    uint32_t msg_id;  /* Random, for log correlation */
+    uint32_t seq;     /* Sender's message counter (+1 per message, from 1; 0 = not counted) */
+    uint32_t epoch;   /* Sender's power-on epoch: seq restarts when it changes (0 = not set) */
+    int32_t latency_us;     /* Receipt minus send in network time (clock error below 0 reads as 0) */
+    uint32_t latency_error_us;  /* Bound on the error of latency_us (both clocks) */
+    bool has_latency;       /* Both ends had network time */
     thread_comms_msg_type_t type;
     union {
         thread_comms_report_t report;
         thread_comms_relay_cmd_t relay_cmd;
+        thread_comms_schedule_t schedule;
     };
 } thread_comms_message_t;
 
 typedef void (*thread_comms_callback_t)(const thread_comms_message_t *msg);
 
+/**
+ * @brief Message pool, MAC and (router) child table counters
+ */
+typedef struct {
+    uint16_t max_children;          /* Children the router accepts */
+    uint16_t children;              /* Attached now */
+    uint16_t sleepy_children;       /* ...of which rx-off (served by indirect transmission) */
+    uint16_t children_peak;
+    uint32_t added;                 /* Child attach notifications (coalesced by OpenThread) */
+    uint32_t removed;               /* Child detach / timeout / eviction notifications */
+    uint16_t queued;                /* Messages in sleepy children's indirect queues now */
+    uint16_t queued_peak;           /* Most messages seen queued for a single child */
+    uint32_t indirect_tx_failed;    /* Indirect frames dropped after max retries (MAC) */
+    uint32_t send_no_bufs;          /* Sends that failed for lack of message buffers */
+    uint32_t send_throttled;        /* ...refused up front to keep buffers for higher priority sends */
+    uint16_t buf_total;             /* OpenThread message pool size (buffers) */
+    uint16_t buf_free;              /* Free now */
+    uint16_t buf_free_min;          /* Low-water mark since boot */
+    uint32_t tx_frames;             /* MAC frames sent (incl. retries) */
+    uint32_t tx_retries;            /* MAC retransmissions */
+    uint32_t tx_cca_failed;         /* Frames that failed clear channel assessment */
+    uint32_t rx_admitted;           /* Received messages that passed admission control */
+    uint32_t rx_throttled;          /* ...dropped because their source was over its rate */
+    uint16_t rx_sources;            /* Sources in the admission table */
+    uint32_t rx_evicted;            /* Sources evicted from a full admission table */
+    uint32_t time_beacons;          /* Router: time beacons sent; end device: beacons applied */
+    uint32_t time_rtt_us;           /* End device: round trip of the beacon in use */
+    uint32_t time_beacons_slow;     /* End device: beacons ignored for their round trip */
+    int32_t time_drift_ppm;         /* End device: estimated clock rate error */
+    uint32_t time_error_us;         /* Bound on the network time error now (0 = time source) */
+    uint32_t time_latency_within_error; /* Received latencies no larger than their error bound */
+    bool time_synced;               /* Network time available */
+} thread_comms_stats_t;
+
 /**
  * @brief UART configuration for RCP connection
  */
@@ -95,7 +145,8 @@ void thread_comms_deinit(void);
 /**
  * @brief Send a sensor report via UDP multicast
  * @param report Report data to send
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if message buffers are low
+ *         (fewer than CONFIG_THREAD_COMMS_BUF_REPORT_MIN_FREE free)
  */
 esp_err_t thread_comms_send_report(const thread_comms_report_t *report);
 
@@ -106,6 +157,14 @@ esp_err_t thread_comms_send_report(const thread_comms_report_t *report);
  */
 esp_err_t thread_comms_send_relay_cmd(const thread_comms_relay_cmd_t *cmd);
 
+/**
+ * @brief Send a report slot assignment via UDP multicast (router)
+ * @param schedule Slot assignment for one device
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if only the relay command
+ *         reserve (CONFIG_THREAD_COMMS_BUF_RESERVE) is left
+ */
+esp_err_t thread_comms_send_schedule(const thread_comms_schedule_t *schedule);
+
 /*── Receiving ──*/
 
 /**
@@ -125,6 +184,39 @@ void thread_comms_set_callback(thread_comms_callback_t callback);
  */
 void thread_comms_poll(void);
 
+/*── Network time ──*/
+
+/**
+ * @brief Current network time
+ *
+ * OpenThread's network time where the build enables time sync
+ * (CONFIG_OPENTHREAD_TIME_SYNC). Otherwise the router's clock is network
+ * time: an end device reporting without it gets a TimeBeacon in reply and
+ * keeps the offset (in RTC memory, across deep sleep) for
+ * CONFIG_THREAD_COMMS_TIME_RESYNC_S, corrected for its estimated clock drift.
+ * Every message is stamped with it and an error bound, so receivers get
+ * one-way latency (thread_comms_message_t.latency_us) with its error bound.
+ *
+ * @param[out] time_us Network time in microseconds
+ * @return true if synchronized (time_us set)
+ */
+bool thread_comms_network_time_us(uint64_t *time_us);
+
+/*── Diagnostics ──*/
+
+/**
+ * @brief Read child table and message pool counters
+ *
+ * Refreshes the child table walk (takes the OpenThread lock). Child fields
+ * stay 0 on end devices.
+ */
+esp_err_t thread_comms_get_stats(thread_comms_stats_t *stats);
+
+/**
+ * @brief Log thread_comms_get_stats() output (child and admission lines on routers only)
+ */
+void thread_comms_log_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
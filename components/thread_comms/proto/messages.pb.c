@@ -12,6 +12,12 @@ PB_BIND(Report, Report, AUTO)
 PB_BIND(RelayCommand, RelayCommand, AUTO)
 
 
+PB_BIND(ScheduleAssignment, ScheduleAssignment, AUTO)
+
+
+PB_BIND(TimeBeacon, TimeBeacon, AUTO)
+
+
 PB_BIND(Message, Message, AUTO)
 
 
@@ -18,6 +18,8 @@ typedef struct _Report {
     float humidity;
     bool has_relay_state;
     bool relay_state;
+    bool has_listen_ms;
+    uint32_t listen_ms; /* Sender keeps receiving this long after the report; absent = always listening */
 } Report;
 
 typedef struct _RelayCommand {
@@ -25,13 +27,33 @@ typedef struct _RelayCommand {
     bool relay_state;
 } RelayCommand;
 
+typedef struct _ScheduleAssignment {
+    char device_id[32];
+    uint32_t period_ms; /* Report every period_ms */
+    uint32_t next_slot_ms; /* Next report slot starts this long after the report this answers */
+    uint32_t slot; /* Slot index (informational) */
+} ScheduleAssignment;
+
+typedef struct _TimeBeacon {
+    char device_id[32]; /* Device whose message asked for it */
+    uint64_t request_sent_us; /* That message's sent_at_us (its sender's clock) */
+    uint64_t request_received_us; /* Network time it arrived at the router */
+} TimeBeacon;
+
 typedef struct _Message {
-    uint32_t msg_id; /* Upper 16 bits: timestamp, lower 16 bits: random */
+    uint32_t msg_id; /* Random, for log correlation */
     pb_size_t which_payload;
     union {
         Report report;
         RelayCommand relay_cmd;
+        ScheduleAssignment schedule;
+        TimeBeacon time;
     } payload;
+    uint64_t sent_at_us; /* Sender's clock at send: network time if time_synced */
+    bool time_synced; /* false on a report asks the router for a TimeBeacon */
+    uint32_t seq; /* Sender's message counter: +1 per message sent, from 1; 0 = not counted */
+    uint32_t time_error_us; /* Bound on the error of sent_at_us if time_synced (0 = time source) */
+    uint32_t epoch; /* Random per sender power-on; seq restarts with it (0 = not set) */
 } Message;
 
 
@@ -40,30 +62,50 @@ extern "C" {
 #endif
 
 /* Initializer values for message structs */
-#define Report_init_default                      {"", false, 0, false, 0, false, 0}
+#define Report_init_default                      {"", false, 0, false, 0, false, 0, false, 0}
 #define RelayCommand_init_default                {"", 0}
-#define Message_init_default                     {0, 0, {Report_init_default}}
-#define Report_init_zero                         {"", false, 0, false, 0, false, 0}
+#define ScheduleAssignment_init_default          {"", 0, 0, 0}
+#define TimeBeacon_init_default                  {"", 0, 0}
+#define Message_init_default                     {0, 0, {Report_init_default}, 0, 0, 0, 0, 0}
+#define Report_init_zero                         {"", false, 0, false, 0, false, 0, false, 0}
 #define RelayCommand_init_zero                   {"", 0}
-#define Message_init_zero                        {0, 0, {Report_init_zero}}
+#define ScheduleAssignment_init_zero             {"", 0, 0, 0}
+#define TimeBeacon_init_zero                     {"", 0, 0}
+#define Message_init_zero                        {0, 0, {Report_init_zero}, 0, 0, 0, 0, 0}
 
 /* Field tags (for use in manual encoding/decoding) */
 #define Report_device_id_tag                     1
 #define Report_temperature_tag                   2
 #define Report_humidity_tag                      3
 #define Report_relay_state_tag                   4
+#define Report_listen_ms_tag                     5
 #define RelayCommand_device_id_tag               1
 #define RelayCommand_relay_state_tag             2
+#define ScheduleAssignment_device_id_tag         1
+#define ScheduleAssignment_period_ms_tag         2
+#define ScheduleAssignment_next_slot_ms_tag      3
+#define ScheduleAssignment_slot_tag              4
+#define TimeBeacon_device_id_tag                 1
+#define TimeBeacon_request_sent_us_tag           2
+#define TimeBeacon_request_received_us_tag       3
 #define Message_msg_id_tag                       1
 #define Message_report_tag                       2
 #define Message_relay_cmd_tag                    3
+#define Message_schedule_tag                     4
+#define Message_time_tag                         5
+#define Message_sent_at_us_tag                   6
+#define Message_time_synced_tag                  7
+#define Message_seq_tag                          8
+#define Message_time_error_us_tag                9
+#define Message_epoch_tag                        10
 
 /* Struct field encoding specification for nanopb */
 #define Report_FIELDLIST(X, a) \
 X(a, STATIC,   SINGULAR, STRING,   device_id,         1) \
 X(a, STATIC,   OPTIONAL, FLOAT,    temperature,       2) \
 X(a, STATIC,   OPTIONAL, FLOAT,    humidity,          3) \
-X(a, STATIC,   OPTIONAL, BOOL,     relay_state,       4)
+X(a, STATIC,   OPTIONAL, BOOL,     relay_state,       4) \
+X(a, STATIC,   OPTIONAL, UINT32,   listen_ms,         5)
 #define Report_CALLBACK NULL
 #define Report_DEFAULT NULL
 
@@ -73,29 +115,59 @@ X(a, STATIC,   SINGULAR, BOOL,     relay_state,       2)
 #define RelayCommand_CALLBACK NULL
 #define RelayCommand_DEFAULT NULL
 
+#define ScheduleAssignment_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, STRING,   device_id,         1) \
+X(a, STATIC,   SINGULAR, UINT32,   period_ms,         2) \
+X(a, STATIC,   SINGULAR, UINT32,   next_slot_ms,      3) \
+X(a, STATIC,   SINGULAR, UINT32,   slot,              4)
+#define ScheduleAssignment_CALLBACK NULL
+#define ScheduleAssignment_DEFAULT NULL
+
+#define TimeBeacon_FIELDLIST(X, a) \
+X(a, STATIC,   SINGULAR, STRING,   device_id,         1) \
+X(a, STATIC,   SINGULAR, UINT64,   request_sent_us,   2) \
+X(a, STATIC,   SINGULAR, UINT64,   request_received_us,   3)
+#define TimeBeacon_CALLBACK NULL
+#define TimeBeacon_DEFAULT NULL
+
 #define Message_FIELDLIST(X, a) \
 X(a, STATIC,   SINGULAR, UINT32,   msg_id,            1) \
 X(a, STATIC,   ONEOF,    MESSAGE,  (payload,report,payload.report),   2) \
-X(a, STATIC,   ONEOF,    MESSAGE,  (payload,relay_cmd,payload.relay_cmd),   3)
+X(a, STATIC,   ONEOF,    MESSAGE,  (payload,relay_cmd,payload.relay_cmd),   3) \
+X(a, STATIC,   ONEOF,    MESSAGE,  (payload,schedule,payload.schedule),   4) \
+X(a, STATIC,   ONEOF,    MESSAGE,  (payload,time,payload.time),   5) \
+X(a, STATIC,   SINGULAR, UINT64,   sent_at_us,        6) \
+X(a, STATIC,   SINGULAR, BOOL,     time_synced,       7) \
+X(a, STATIC,   SINGULAR, UINT32,   seq,               8) \
+X(a, STATIC,   SINGULAR, UINT32,   time_error_us,     9) \
+X(a, STATIC,   SINGULAR, UINT32,   epoch,            10)
 #define Message_CALLBACK NULL
 #define Message_DEFAULT NULL
 #define Message_payload_report_MSGTYPE Report
 #define Message_payload_relay_cmd_MSGTYPE RelayCommand
+#define Message_payload_schedule_MSGTYPE ScheduleAssignment
+#define Message_payload_time_MSGTYPE TimeBeacon
 
 extern const pb_msgdesc_t Report_msg;
 extern const pb_msgdesc_t RelayCommand_msg;
+extern const pb_msgdesc_t ScheduleAssignment_msg;
+extern const pb_msgdesc_t TimeBeacon_msg;
 extern const pb_msgdesc_t Message_msg;
 
 /* Defines for backwards compatibility with code written before nanopb-0.4.0 */
 #define Report_fields &Report_msg
 #define RelayCommand_fields &RelayCommand_msg
+#define ScheduleAssignment_fields &ScheduleAssignment_msg
+#define TimeBeacon_fields &TimeBeacon_msg
 #define Message_fields &Message_msg
 
 /* Maximum encoded size of messages (where known) */
 #define MESSAGES_PB_H_MAX_SIZE                   Message_size
-#define Message_size                             53
+#define Message_size                             94
 #define RelayCommand_size                        35
-#define Report_size                              45
+#define Report_size                              51
+#define ScheduleAssignment_size                  51
+#define TimeBeacon_size                          55
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -1,23 +1,36 @@
 #include "thread_comms.h"
 
 #include <string.h>
+#include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_openthread.h"
 #include "esp_openthread_lock.h"
 #include "esp_openthread_netif_glue.h"
 #include "esp_openthread_types.h"
 
+#include "dlog.h"
+#include "event_trace.h"
+#include "power_management.h"
+
 #include "openthread/dataset.h"
 #include "openthread/instance.h"
 #include "openthread/ip6.h"
 #include "openthread/link.h"
 #include "openthread/logging.h"
+#if CONFIG_OPENTHREAD_TIME_SYNC
+#include "openthread/network_time.h"
+#endif
 #include "openthread/thread.h"
+#if CONFIG_OPENTHREAD_FTD
+#include "openthread/thread_ftd.h"
+#endif
 #include "openthread/udp.h"
 
 /* Compatibility: older OpenThread uses OT_NETIF_THREAD, newer uses OT_NETIF_THREAD_HOST */
@@ -42,17 +55,105 @@ static otUdpSocket g_socket;
 static bool g_initialized = false;
 static thread_comms_callback_t g_callback = NULL;
 
+/* Child table, message pool and send counters (under the OpenThread lock) */
+static thread_comms_stats_t g_stats;
+
+/* Free message buffers a send needs before it allocates, by priority. A
+   normal send takes one buffer, so it needs one more than the reserve. */
+#define SEND_MIN_FREE_REPORT    CONFIG_THREAD_COMMS_BUF_REPORT_MIN_FREE
+#define SEND_MIN_FREE_NORMAL    (CONFIG_THREAD_COMMS_BUF_RESERVE + 1)
+#define SEND_MIN_FREE_COMMAND   0
+
+#if CONFIG_THREAD_COMMS_BUF_REPORT_MIN_FREE <= CONFIG_THREAD_COMMS_BUF_RESERVE
+#error "CONFIG_THREAD_COMMS_BUF_REPORT_MIN_FREE must be above CONFIG_THREAD_COMMS_BUF_RESERVE"
+#endif
+
+/* Network time offset from the latest TimeBeacon (end device, kept across deep sleep) */
+static RTC_DATA_ATTR struct {
+    bool valid;
+    int64_t offset_us;      /* Network time minus local clock */
+    int64_t synced_at_us;   /* Local clock when it was taken */
+    uint32_t rtt_us;        /* Round trip of the beacon it came from */
+    int32_t drift_ppm;      /* Local clock rate error, estimated across beacons (+ = slow) */
+} g_time;
+
+#define TIME_RESYNC_US      ((int64_t)CONFIG_THREAD_COMMS_TIME_RESYNC_S * 1000000)
+#define TIME_MAX_RTT_US     ((int64_t)CONFIG_THREAD_COMMS_TIME_MAX_RTT_MS * 1000)
+#define TIME_MAX_DRIFT_PPM  50000   /* RC slow clock is within a few % */
+
+/* Messages handed to OpenThread; kept across deep sleep so receivers can count
+   gaps. Restarts from 0 on any other reset, together with a new random epoch
+   that tells receivers the count started over (even if its first messages are lost). */
+static RTC_DATA_ATTR uint32_t g_tx_seq;
+static RTC_DATA_ATTR uint32_t g_tx_epoch;
+
+/* CPU boosts around CPU-bound radio phases (encode/decode, frame security, MLE) */
+static pm_boost_t g_boost_send = NULL;
+static pm_boost_t g_boost_recv = NULL;
+static pm_boost_t g_boost_attach = NULL;
+
 /*── Forward declarations ──*/
 
 static void handle_receive(void *context, otMessage *message, const otMessageInfo *info);
+static esp_err_t send_message(Message *msg, uint16_t min_free);
 
 /*── Internal ──*/
 
 static uint32_t generate_msg_id(void)
 {
-    uint32_t time_part = (uint32_t)(esp_timer_get_time() / 1000000) & 0xFFFF;  /* Seconds, lower 16 bits */
-    uint32_t rand_part = esp_random() & 0xFFFF;
-    return (time_part << 16) | rand_part;
+    /* Uptime restarts on every deep sleep wake - timing goes in sent_at_us */
+    return esp_random();
+}
+
+/**
+ * Local clock: keeps counting through deep sleep (RTC slow clock), unlike esp_timer
+ */
+static int64_t local_clock_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Network time at local clock local_us. Caller holds the OpenThread lock.
+ */
+static bool network_time_at(int64_t local_us, uint64_t *time_us)
+{
+#if CONFIG_OPENTHREAD_TIME_SYNC
+    (void)local_us;
+    return otNetworkTimeGet(esp_openthread_get_instance(), time_us) == OT_NETWORK_TIME_SYNCHRONIZED;
+#else
+    /* The router is the time source */
+    if (g_source == THREAD_COMMS_SOURCE_ROUTER) {
+        *time_us = (uint64_t)local_us;
+        return true;
+    }
+    int64_t age = local_us - g_time.synced_at_us;
+    if (!g_time.valid || age > TIME_RESYNC_US) {
+        return false;
+    }
+    *time_us = (uint64_t)(local_us + g_time.offset_us + age * g_time.drift_ppm / 1000000);
+    return true;
+#endif
+}
+
+/**
+ * Bound on the error of network_time_at(local_us): half the beacon's round
+ * trip plus the drift left after correction since then. 0 on the time source.
+ */
+static uint32_t network_time_error_at(int64_t local_us)
+{
+#if CONFIG_OPENTHREAD_TIME_SYNC
+    (void)local_us;
+    return 0;
+#else
+    if (g_source == THREAD_COMMS_SOURCE_ROUTER) {
+        return 0;
+    }
+    int64_t error = g_time.rtt_us / 2 + (local_us - g_time.synced_at_us) * CONFIG_THREAD_COMMS_TIME_DRIFT_PPM / 1000000;
+    return error > UINT32_MAX ? UINT32_MAX : (uint32_t)error;
+#endif
 }
 
 static const char *role_to_string(otDeviceRole role)
@@ -67,6 +168,63 @@ static const char *role_to_string(otDeviceRole role)
     }
 }
 
+#if CONFIG_OPENTHREAD_FTD
+/**
+ * Walk the child table: occupancy and indirect queue depth of sleepy children.
+ * Caller holds the OpenThread lock.
+ */
+static void update_child_stats(otInstance *instance)
+{
+    uint16_t max_children = otThreadGetMaxAllowedChildren(instance);
+    uint16_t children = 0;
+    uint16_t sleepy = 0;
+    uint16_t queued = 0;
+
+    for (uint16_t i = 0; i < max_children; i++) {
+        otChildInfo info;
+        if (otThreadGetChildInfoByIndex(instance, i, &info) != OT_ERROR_NONE) {
+            continue;
+        }
+        children++;
+        if (info.mRxOnWhenIdle) {
+            continue;
+        }
+        sleepy++;
+        queued += info.mQueuedMessageCnt;
+        if (info.mQueuedMessageCnt > g_stats.queued_peak) {
+            g_stats.queued_peak = info.mQueuedMessageCnt;
+        }
+        if (info.mQueuedMessageCnt >= CONFIG_THREAD_COMMS_INDIRECT_QUEUE_WARN) {
+            DLOGW(TAG, "Child 0x%04x has %u messages queued", info.mRloc16, info.mQueuedMessageCnt);
+        }
+    }
+
+    g_stats.max_children = max_children;
+    g_stats.children = children;
+    g_stats.sleepy_children = sleepy;
+    g_stats.queued = queued;
+    if (children > g_stats.children_peak) {
+        g_stats.children_peak = children;
+    }
+    g_stats.indirect_tx_failed = otLinkGetCounters(instance)->mTxIndirectMaxRetryExpiry;
+}
+#endif
+
+/**
+ * Sample the message pool gauge. Caller holds the OpenThread lock.
+ * Returns the free buffer count.
+ */
+static uint16_t sample_buffers(otInstance *instance)
+{
+    otBufferInfo info;
+    otMessageGetBufferInfo(instance, &info);
+    g_stats.buf_total = info.mTotalBuffers;
+    g_stats.buf_free = info.mFreeBuffers;
+    /* OpenThread tracks the peak itself, so the low-water mark is exact between samples */
+    g_stats.buf_free_min = info.mTotalBuffers - info.mMaxUsedBuffers;
+    return info.mFreeBuffers;
+}
+
 static void ot_state_changed(otChangedFlags flags, void *ctx)
 {
     otInstance *instance = esp_openthread_get_instance();
@@ -78,11 +236,20 @@ static void ot_state_changed(otChangedFlags flags, void *ctx)
 
     if (g_source == THREAD_COMMS_SOURCE_ROUTER) {
         if (flags & OT_CHANGED_THREAD_CHILD_ADDED) {
+            g_stats.added++;
             ESP_LOGI(TAG, "Child joined the network");
         }
         if (flags & OT_CHANGED_THREAD_CHILD_REMOVED) {
+            g_stats.removed++;
             ESP_LOGI(TAG, "Child left the network");
         }
+#if CONFIG_OPENTHREAD_FTD
+        if (flags & (OT_CHANGED_THREAD_CHILD_ADDED | OT_CHANGED_THREAD_CHILD_REMOVED)) {
+            update_child_stats(instance);
+            ESP_LOGI(TAG, "Children: %u/%u (%u sleepy), %u messages queued",
+                     g_stats.children, g_stats.max_children, g_stats.sleepy_children, g_stats.queued);
+        }
+#endif
     }
 }
 
@@ -96,6 +263,18 @@ static void ot_mainloop(void *arg)
 #include "driver/uart.h"
 #endif
 
+static bool dataset_matches(const otOperationalDataset *a, const otOperationalDataset *b)
+{
+    return a->mComponents.mIsNetworkKeyPresent && a->mComponents.mIsExtendedPanIdPresent &&
+           a->mComponents.mIsPanIdPresent && a->mComponents.mIsChannelPresent &&
+           a->mComponents.mIsMeshLocalPrefixPresent &&
+           memcmp(a->mNetworkKey.m8, b->mNetworkKey.m8, sizeof(a->mNetworkKey.m8)) == 0 &&
+           memcmp(a->mExtendedPanId.m8, b->mExtendedPanId.m8, sizeof(a->mExtendedPanId.m8)) == 0 &&
+           memcmp(a->mMeshLocalPrefix.m8, b->mMeshLocalPrefix.m8, sizeof(a->mMeshLocalPrefix.m8)) == 0 &&
+           strcmp(a->mNetworkName.m8, b->mNetworkName.m8) == 0 &&
+           a->mPanId == b->mPanId && a->mChannel == b->mChannel;
+}
+
 static void configure_dataset(otInstance *instance)
 {
     otOperationalDataset dataset;
@@ -152,6 +331,18 @@ static void configure_dataset(otInstance *instance)
         dataset.mComponents.mIsPskcPresent = true;
     }
 
+    /* Keep the dataset OpenThread restored from NVS when it is the same
+       network, so a rebooted router resumes its stored role instead of
+       forming the network again */
+    otOperationalDataset active;
+    if (otDatasetIsCommissioned(instance) &&
+        otDatasetGetActive(instance, &active) == OT_ERROR_NONE &&
+        dataset_matches(&active, &dataset)) {
+        ESP_LOGI(TAG, "Using persisted Thread dataset");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Setting Thread dataset");
     otDatasetSetActive(instance, &dataset);
 }
 
@@ -227,24 +418,105 @@ static esp_err_t start_udp(void)
     return ESP_OK;
 }
 
+/*── Network time ──*/
+
+#if !CONFIG_OPENTHREAD_TIME_SYNC
 /**
- * Handle received UDP message
+ * Router: answer a report sent without network time (OpenThread task)
  */
-static void handle_receive(void *context, otMessage *message, const otMessageInfo *info)
+static void send_time_beacon(const char *device_id, uint64_t request_sent_us, uint64_t request_received_us)
 {
-    (void)context;
-    (void)info;
+    Message msg = Message_init_zero;
+    msg.msg_id = generate_msg_id();
+    msg.which_payload = Message_time_tag;
+    strncpy(msg.payload.time.device_id, device_id, sizeof(msg.payload.time.device_id) - 1);
+    msg.payload.time.request_sent_us = request_sent_us;
+    msg.payload.time.request_received_us = request_received_us;
+
+    /* The OpenThread lock is recursive, so sending from the receive callback is fine */
+    if (send_message(&msg, SEND_MIN_FREE_NORMAL) == ESP_OK) {
+        g_stats.time_beacons++;
+    }
+}
+#endif
+
+/**
+ * End device: take network time from a beacon answering one of our messages.
+ * Offset and round trip NTP style: t1 request sent (local clock), t2 request
+ * received and t3 beacon sent (network time), t4 beacon received (local clock).
+ * The beacon waits in the parent's indirect queue until our next poll, so the
+ * round trip bounds the error: slow beacons are ignored, and a beacon replaces
+ * the offset in use only if its error bound is tighter than that offset's now.
+ * The offset's change between beacons far enough apart gives the clock drift.
+ */
+static void apply_time_beacon(const TimeBeacon *beacon, uint64_t sent_at_us, int64_t rx_us)
+{
+#if CONFIG_OPENTHREAD_TIME_SYNC
+    (void)beacon; (void)sent_at_us; (void)rx_us;
+#else
+    if (g_source != THREAD_COMMS_SOURCE_END_DEVICE || strcmp(beacon->device_id, g_device_id) != 0) {
+        return;
+    }
+
+    int64_t t1 = (int64_t)beacon->request_sent_us;
+    int64_t t2 = (int64_t)beacon->request_received_us;
+    int64_t t3 = (int64_t)sent_at_us;
+    int64_t t4 = rx_us;
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0 || rtt > UINT32_MAX) {
+        return;     /* Not an echo of our clock (e.g. we rebooted since) */
+    }
+    if (rtt > TIME_MAX_RTT_US) {
+        g_stats.time_beacons_slow++;
+        DLOGI(TAG, "Ignoring time beacon (round trip %lld us)", (long long)rtt);
+        return;
+    }
 
+    int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+    int64_t elapsed = rx_us - g_time.synced_at_us;
+    bool stale = !g_time.valid || elapsed > TIME_RESYNC_US;
+    if (!stale && rtt / 2 >= network_time_error_at(rx_us)) {
+        return;
+    }
+
+    if (g_time.valid && elapsed > 0) {
+        /* Only once the two offsets' errors are small against the time between them */
+        int64_t uncertainty_ppm = ((int64_t)g_time.rtt_us + rtt) / 2 * 1000000 / elapsed;
+        if (uncertainty_ppm <= CONFIG_THREAD_COMMS_TIME_DRIFT_PPM) {
+            int64_t predicted = g_time.offset_us + elapsed * g_time.drift_ppm / 1000000;
+            int64_t ppm = g_time.drift_ppm + (offset - predicted) * 1000000 / elapsed / 2;
+            g_time.drift_ppm = ppm > TIME_MAX_DRIFT_PPM ? TIME_MAX_DRIFT_PPM
+                             : ppm < -TIME_MAX_DRIFT_PPM ? -TIME_MAX_DRIFT_PPM : (int32_t)ppm;
+        }
+    } else {
+        g_time.drift_ppm = 0;
+    }
+
+    g_time.offset_us = offset;
+    g_time.synced_at_us = rx_us;
+    g_time.rtt_us = (uint32_t)rtt;
+    g_time.valid = true;
+    g_stats.time_beacons++;
+    ESP_LOGI(TAG, "Network time synced (round trip %lu us, drift %ld ppm)",
+             (unsigned long)g_time.rtt_us, (long)g_time.drift_ppm);
+#endif
+}
+
+/**
+ * Decode a received UDP message and dispatch it to the callback
+ */
+static void process_receive(otMessage *message, int64_t rx_us)
+{
     uint16_t len = otMessageGetLength(message) - otMessageGetOffset(message);
     if (len > Message_size + 16) {
-        ESP_LOGW(TAG, "Message too large: %d bytes", len);
+        DLOGW(TAG, "Message too large: %d bytes", len);
         return;
     }
 
     uint8_t buffer[Message_size + 16];
     uint16_t read = otMessageRead(message, otMessageGetOffset(message), buffer, len);
     if (read != len) {
-        ESP_LOGW(TAG, "Failed to read message data");
+        DLOGW(TAG, "Failed to read message data");
         return;
     }
 
@@ -252,11 +524,24 @@ static void handle_receive(void *context, otMessage *message, const otMessageInf
     Message msg = Message_init_zero;
     pb_istream_t stream = pb_istream_from_buffer(buffer, len);
     if (!pb_decode(&stream, Message_fields, &msg)) {
-        ESP_LOGW(TAG, "Failed to decode message: %s", PB_GET_ERROR(&stream));
+        DLOGW(TAG, "Failed to decode message: %s", PB_GET_ERROR(&stream));
         return;
     }
 
-    ESP_LOGI(TAG, "Recv msg_id=%08lx", (unsigned long)msg.msg_id);
+    DLOGI(TAG, "Recv msg_id=%08lx", (unsigned long)msg.msg_id);
+
+    uint64_t rx_time;
+    bool synced = network_time_at(rx_us, &rx_time);
+
+    if (msg.which_payload == Message_time_tag) {
+        apply_time_beacon(&msg.payload.time, msg.sent_at_us, rx_us);
+        return;
+    }
+#if !CONFIG_OPENTHREAD_TIME_SYNC
+    if (g_source == THREAD_COMMS_SOURCE_ROUTER && msg.which_payload == Message_report_tag && !msg.time_synced) {
+        send_time_beacon(msg.payload.report.device_id, msg.sent_at_us, rx_time);
+    }
+#endif
 
     if (g_callback == NULL) {
         return;
@@ -265,6 +550,21 @@ static void handle_receive(void *context, otMessage *message, const otMessageInf
     thread_comms_message_t out;
     memset(&out, 0, sizeof(out));
     out.msg_id = msg.msg_id;
+    out.seq = msg.seq;
+    out.epoch = msg.epoch;
+    if (synced && msg.time_synced) {
+        /* Both clocks' error bounds add up. Every sample is kept with its
+           bound; one hop is often shorter than the bound, so dropping those
+           would leave only the slow samples */
+        int64_t latency = (int64_t)(rx_time - msg.sent_at_us);
+        int64_t error = (int64_t)msg.time_error_us + network_time_error_at(rx_us);
+        if (error > latency) {
+            g_stats.time_latency_within_error++;
+        }
+        out.latency_us = latency < 0 ? 0 : latency > INT32_MAX ? INT32_MAX : (int32_t)latency;
+        out.latency_error_us = error > UINT32_MAX ? UINT32_MAX : (uint32_t)error;
+        out.has_latency = true;
+    }
 
     if (msg.which_payload == Message_report_tag) {
         out.type = THREAD_COMMS_MSG_REPORT;
@@ -275,41 +575,174 @@ static void handle_receive(void *context, otMessage *message, const otMessageInf
         out.report.humidity = msg.payload.report.humidity;
         out.report.has_relay_state = msg.payload.report.has_relay_state;
         out.report.relay_state = msg.payload.report.relay_state;
+        out.report.has_listen_ms = msg.payload.report.has_listen_ms;
+        out.report.listen_ms = msg.payload.report.listen_ms;
     } else if (msg.which_payload == Message_relay_cmd_tag) {
         out.type = THREAD_COMMS_MSG_RELAY_CMD;
         strncpy(out.relay_cmd.device_id, msg.payload.relay_cmd.device_id, sizeof(out.relay_cmd.device_id) - 1);
         out.relay_cmd.relay_state = msg.payload.relay_cmd.relay_state;
+    } else if (msg.which_payload == Message_schedule_tag) {
+        out.type = THREAD_COMMS_MSG_SCHEDULE;
+        strncpy(out.schedule.device_id, msg.payload.schedule.device_id, sizeof(out.schedule.device_id) - 1);
+        out.schedule.period_ms = msg.payload.schedule.period_ms;
+        out.schedule.next_slot_ms = msg.payload.schedule.next_slot_ms;
+        out.schedule.slot = msg.payload.schedule.slot;
     } else {
-        ESP_LOGW(TAG, "Unknown message payload type");
+        DLOGW(TAG, "Unknown message payload type");
         return;
     }
 
     g_callback(&out);
 }
 
+/*── Admission control (router) ──*/
+
+#if CONFIG_THREAD_COMMS_RX_RATE_PER_MIN > 0
+
+#define RX_TOKEN 1000   /* Tokens are kept in thousandths */
+
+typedef struct {
+    uint64_t iid;       /* Interface identifier of the source address, 0 = free */
+    uint32_t last_ms;   /* Last refill */
+    uint32_t tokens;
+} rx_bucket_t;
+
+/* Accessed from the OpenThread task only (receive callback) */
+static rx_bucket_t g_rx_buckets[CONFIG_THREAD_COMMS_RX_SOURCES];
+
+#define RX_PROBE 8      /* Slots searched per lookup */
+
+static rx_bucket_t *rx_bucket_for(uint64_t iid, uint32_t now_ms)
+{
+    uint32_t h = (uint32_t)(iid ^ (iid >> 32)) * 0x9e3779b1u;
+    uint32_t start = (h >> 16) % CONFIG_THREAD_COMMS_RX_SOURCES;
+    rx_bucket_t *oldest = NULL;
+
+    for (uint32_t i = 0; i < RX_PROBE; i++) {
+        rx_bucket_t *b = &g_rx_buckets[(start + i) % CONFIG_THREAD_COMMS_RX_SOURCES];
+        if (b->iid == iid) {
+            return b;
+        }
+        if (b->iid == 0) {
+            g_stats.rx_sources++;
+            oldest = b;
+            break;
+        }
+        if (oldest == NULL || (int32_t)(b->last_ms - oldest->last_ms) < 0) {
+            oldest = b;
+        }
+    }
+
+    if (oldest->iid != 0) {
+        g_stats.rx_evicted++;
+    }
+    oldest->iid = iid;
+    oldest->last_ms = now_ms;
+    oldest->tokens = CONFIG_THREAD_COMMS_RX_BURST * RX_TOKEN;
+    return oldest;
+}
+
 /**
- * Send raw protobuf message via UDP multicast
+ * Token bucket per source: refill by elapsed time, spend one token per message
  */
-static esp_err_t send_message(const Message *msg)
+static bool rx_admit(const otMessageInfo *info)
+{
+    uint64_t iid;
+    memcpy(&iid, &info->mPeerAddr.mFields.m8[8], sizeof(iid));
+    if (iid == 0) {
+        iid = 1;    /* Keep 0 for free slots */
+    }
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    rx_bucket_t *b = rx_bucket_for(iid, now_ms);
+
+    uint32_t elapsed_ms = now_ms - b->last_ms;
+    b->last_ms = now_ms;
+    uint64_t tokens = b->tokens + (uint64_t)elapsed_ms * CONFIG_THREAD_COMMS_RX_RATE_PER_MIN * RX_TOKEN / 60000;
+    if (tokens > CONFIG_THREAD_COMMS_RX_BURST * RX_TOKEN) {
+        tokens = CONFIG_THREAD_COMMS_RX_BURST * RX_TOKEN;
+    }
+
+    if (tokens < RX_TOKEN) {
+        b->tokens = (uint32_t)tokens;
+        g_stats.rx_throttled++;
+        return false;
+    }
+    b->tokens = (uint32_t)(tokens - RX_TOKEN);
+    g_stats.rx_admitted++;
+    return true;
+}
+
+#endif
+
+/**
+ * Handle received UDP message
+ */
+static void handle_receive(void *context, otMessage *message, const otMessageInfo *info)
+{
+    (void)context;
+    int64_t rx_us = local_clock_us();     /* Before admission and decoding */
+
+#if CONFIG_THREAD_COMMS_RX_RATE_PER_MIN > 0
+    if (g_source == THREAD_COMMS_SOURCE_ROUTER && !rx_admit(info)) {
+        DLOGI_SAMPLED(TAG, 16, "Source over its rate, dropped message (%lu throttled)",
+                      (unsigned long)g_stats.rx_throttled);
+        return;
+    }
+#else
+    (void)info;
+#endif
+
+    TRACE_BEGIN(TRACE_ID_TC_RECEIVE, 0);
+    pm_boost_begin(g_boost_recv);
+    process_receive(message, rx_us);
+    pm_boost_end(g_boost_recv);
+    dlog_count_message();
+    TRACE_END(TRACE_ID_TC_RECEIVE, 0);
+}
+
+/**
+ * Encode and send raw protobuf message via UDP multicast
+ */
+static esp_err_t encode_and_send(Message *msg, uint16_t min_free)
 {
     otInstance *instance = esp_openthread_get_instance();
     if (instance == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
 
-    /* Encode message */
+    esp_openthread_lock_acquire(portMAX_DELAY);
+
+    /* Leave scarce buffers to higher priority sends */
+    uint16_t free_bufs = sample_buffers(instance);
+    if (free_bufs < min_free) {
+        g_stats.send_throttled++;
+        esp_openthread_lock_release();
+        DLOGI_SAMPLED(TAG, 16, "Message buffers low (%u free, need %u), send refused", free_bufs, min_free);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Stamp and encode last, so sent_at_us excludes waiting for the lock */
+    uint64_t now;
+    int64_t local_us = local_clock_us();
+    msg->time_synced = network_time_at(local_us, &now);
+    msg->sent_at_us = msg->time_synced ? now : (uint64_t)local_us;
+    msg->time_error_us = msg->time_synced ? network_time_error_at(local_us) : 0;
+    msg->seq = g_tx_seq + 1;    /* Taken only once OpenThread accepts the message */
+    msg->epoch = g_tx_epoch;
+
     uint8_t buffer[Message_size];
     pb_ostream_t stream = pb_ostream_from_buffer(buffer, sizeof(buffer));
     if (!pb_encode(&stream, Message_fields, msg)) {
+        esp_openthread_lock_release();
         ESP_LOGE(TAG, "Failed to encode message: %s", PB_GET_ERROR(&stream));
         return ESP_FAIL;
     }
 
-    esp_openthread_lock_acquire(portMAX_DELAY);
-
     /* Create OpenThread message */
     otMessage *ot_msg = otUdpNewMessage(instance, NULL);
     if (ot_msg == NULL) {
+        g_stats.send_no_bufs++;
         ESP_LOGE(TAG, "Failed to allocate OT message");
         esp_openthread_lock_release();
         return ESP_ERR_NO_MEM;
@@ -331,6 +764,21 @@ static esp_err_t send_message(const Message *msg)
     info.mPeerPort = THREAD_COMMS_PORT;
 
     err = otUdpSend(instance, &g_socket, ot_msg, &info);
+    if (err == OT_ERROR_NO_BUFS) {
+        g_stats.send_no_bufs++;
+    }
+    if (err == OT_ERROR_NONE) {
+        g_tx_seq = msg->seq;
+#if !CONFIG_OPENTHREAD_TIME_SYNC
+        /* The router answers an unsynced report with a TimeBeacon. Poll for it
+           now rather than at the next poll period, which its round trip would include */
+        if (!msg->time_synced && g_source == THREAD_COMMS_SOURCE_END_DEVICE &&
+            msg->which_payload == Message_report_tag) {
+            otLinkSendDataRequest(instance);
+        }
+#endif
+    }
+    sample_buffers(instance);
 
     esp_openthread_lock_release();
 
@@ -339,26 +787,29 @@ static esp_err_t send_message(const Message *msg)
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Sent msg_id=%08lx", (unsigned long)msg->msg_id);
+    DLOGI(TAG, "Sent msg_id=%08lx", (unsigned long)msg->msg_id);
     return ESP_OK;
 }
 
-/*── Public API ──*/
-
-esp_err_t thread_comms_init(const thread_comms_config_t *config)
+/**
+ * Send raw protobuf message via UDP multicast
+ */
+static esp_err_t send_message(Message *msg, uint16_t min_free)
 {
-    if (g_initialized) {
-        return ESP_ERR_INVALID_STATE;
-    }
-
-    strncpy(g_device_id, config->device_id, sizeof(g_device_id) - 1);
-    g_device_id[sizeof(g_device_id) - 1] = '\0';
-    g_source = config->source;
-
-    const char *type_str = (config->source == THREAD_COMMS_SOURCE_ROUTER) ? "router" : "end-device";
-    const char *radio_str = config->use_uart_rcp ? "UART RCP" : "native";
-    ESP_LOGI(TAG, "Initializing as '%s' (%s, %s)", config->device_id, type_str, radio_str);
+    TRACE_BEGIN(TRACE_ID_TC_SEND, msg->msg_id);
+    pm_boost_begin(g_boost_send);
+    esp_err_t ret = encode_and_send(msg, min_free);
+    pm_boost_end(g_boost_send);
+    dlog_count_message();
+    TRACE_END(TRACE_ID_TC_SEND, msg->msg_id);
+    return ret;
+}
 
+/**
+ * Bring up OpenThread and wait until attached to the network
+ */
+static esp_err_t attach(const thread_comms_config_t *config)
+{
     /* OpenThread platform init */
     esp_openthread_platform_config_t ot_config = {
         .host_config = { .host_connection_mode = HOST_CONNECTION_MODE_NONE },
@@ -386,6 +837,9 @@ esp_err_t thread_comms_init(const thread_comms_config_t *config)
         ot_config.radio_config.radio_mode = RADIO_MODE_NATIVE;
     }
 
+    /* Boost only the CPU-bound setup - the role waits below would otherwise
+       hold the CPU at max (and block light sleep) for the whole attach */
+    pm_boost_begin(g_boost_attach);
     ESP_ERROR_CHECK(esp_openthread_init(&ot_config));
 
     /* Create OpenThread netif */
@@ -400,10 +854,21 @@ esp_err_t thread_comms_init(const thread_comms_config_t *config)
     /* Configure dataset and enable Thread */
     esp_openthread_lock_acquire(portMAX_DELAY);
     configure_dataset(instance);
+#if CONFIG_OPENTHREAD_FTD
+    if (config->source == THREAD_COMMS_SOURCE_ROUTER) {
+        /* Must be set while Thread is disabled */
+        otError ot_err = otThreadSetMaxAllowedChildren(instance, CONFIG_THREAD_COMMS_MAX_CHILDREN);
+        if (ot_err != OT_ERROR_NONE) {
+            ESP_LOGW(TAG, "Failed to allow %d children (OPENTHREAD_MLE_MAX_CHILDREN too low?): %d",
+                     CONFIG_THREAD_COMMS_MAX_CHILDREN, ot_err);
+        }
+    }
+#endif
     otSetStateChangedCallback(instance, ot_state_changed, NULL);
     otIp6SetEnabled(instance, true);
     otThreadSetEnabled(instance, true);
     esp_openthread_lock_release();
+    pm_boost_end(g_boost_attach);
 
     /* Start OpenThread mainloop task - UART RCP mode needs larger stack for VFS/select */
     xTaskCreate(ot_mainloop, "ot_mainloop", 8192, NULL, 5, NULL);
@@ -423,8 +888,42 @@ esp_err_t thread_comms_init(const thread_comms_config_t *config)
         ESP_LOGI(TAG, "Re-attached as SED");
     }
 
+    return ESP_OK;
+}
+
+/*── Public API ──*/
+
+esp_err_t thread_comms_init(const thread_comms_config_t *config)
+{
+    if (g_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    strncpy(g_device_id, config->device_id, sizeof(g_device_id) - 1);
+    g_device_id[sizeof(g_device_id) - 1] = '\0';
+    g_source = config->source;
+
+    while (g_tx_epoch == 0) {
+        g_tx_epoch = esp_random();
+    }
+
+    const char *type_str = (config->source == THREAD_COMMS_SOURCE_ROUTER) ? "router" : "end-device";
+    const char *radio_str = config->use_uart_rcp ? "UART RCP" : "native";
+    ESP_LOGI(TAG, "Initializing as '%s' (%s, %s)", config->device_id, type_str, radio_str);
+
+    if (g_boost_attach == NULL) {
+        g_boost_send = pm_boost_create("tc_send");
+        g_boost_recv = pm_boost_create("tc_recv");
+        g_boost_attach = pm_boost_create("tc_attach");
+    }
+
+    esp_err_t ret = attach(config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
     /* Start UDP messaging */
-    esp_err_t ret = start_udp();
+    ret = start_udp();
     if (ret != ESP_OK) {
         return ret;
     }
@@ -476,8 +975,12 @@ esp_err_t thread_comms_send_report(const thread_comms_report_t *report)
         msg.payload.report.has_relay_state = true;
         msg.payload.report.relay_state = report->relay_state;
     }
+    if (report->has_listen_ms) {
+        msg.payload.report.has_listen_ms = true;
+        msg.payload.report.listen_ms = report->listen_ms;
+    }
 
-    return send_message(&msg);
+    return send_message(&msg, SEND_MIN_FREE_REPORT);
 }
 
 esp_err_t thread_comms_send_relay_cmd(const thread_comms_relay_cmd_t *cmd)
@@ -492,7 +995,36 @@ esp_err_t thread_comms_send_relay_cmd(const thread_comms_relay_cmd_t *cmd)
     strncpy(msg.payload.relay_cmd.device_id, cmd->device_id, sizeof(msg.payload.relay_cmd.device_id) - 1);
     msg.payload.relay_cmd.relay_state = cmd->relay_state;
 
-    return send_message(&msg);
+    return send_message(&msg, SEND_MIN_FREE_COMMAND);
+}
+
+esp_err_t thread_comms_send_schedule(const thread_comms_schedule_t *schedule)
+{
+    if (!g_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    Message msg = Message_init_zero;
+    msg.msg_id = generate_msg_id();
+    msg.which_payload = Message_schedule_tag;
+    strncpy(msg.payload.schedule.device_id, schedule->device_id, sizeof(msg.payload.schedule.device_id) - 1);
+    msg.payload.schedule.period_ms = schedule->period_ms;
+    msg.payload.schedule.next_slot_ms = schedule->next_slot_ms;
+    msg.payload.schedule.slot = schedule->slot;
+
+    return send_message(&msg, SEND_MIN_FREE_NORMAL);
+}
+
+bool thread_comms_network_time_us(uint64_t *time_us)
+{
+    if (esp_openthread_get_instance() == NULL) {
+        return false;
+    }
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+    bool synced = network_time_at(local_clock_us(), time_us);
+    esp_openthread_lock_release();
+    return synced;
 }
 
 void thread_comms_set_callback(thread_comms_callback_t callback)
@@ -513,3 +1045,65 @@ void thread_comms_poll(void)
         esp_openthread_lock_release();
     }
 }
+
+esp_err_t thread_comms_get_stats(thread_comms_stats_t *stats)
+{
+    otInstance *instance = esp_openthread_get_instance();
+    if (instance == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_openthread_lock_acquire(portMAX_DELAY);
+#if CONFIG_OPENTHREAD_FTD
+    if (g_source == THREAD_COMMS_SOURCE_ROUTER) {
+        update_child_stats(instance);
+    }
+#endif
+    const otMacCounters *mac = otLinkGetCounters(instance);
+    g_stats.tx_frames = mac->mTxTotal;
+    g_stats.tx_retries = mac->mTxRetry;
+    g_stats.tx_cca_failed = mac->mTxErrCca;
+    sample_buffers(instance);
+    uint64_t now;
+    g_stats.time_synced = network_time_at(local_clock_us(), &now);
+    g_stats.time_rtt_us = g_time.rtt_us;
+    g_stats.time_drift_ppm = g_time.drift_ppm;
+    g_stats.time_error_us = g_stats.time_synced ? network_time_error_at(local_clock_us()) : 0;
+    *stats = g_stats;
+    esp_openthread_lock_release();
+    return ESP_OK;
+}
+
+void thread_comms_log_stats(void)
+{
+    thread_comms_stats_t s;
+    if (thread_comms_get_stats(&s) != ESP_OK) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "MAC: %lu frames sent, %lu retries, %lu CCA failures; %lu sends out of buffers",
+             (unsigned long)s.tx_frames, (unsigned long)s.tx_retries, (unsigned long)s.tx_cca_failed,
+             (unsigned long)s.send_no_bufs);
+    ESP_LOGI(TAG, "  message buffers: %u/%u free, low-water %u; %lu sends throttled",
+             s.buf_free, s.buf_total, s.buf_free_min, (unsigned long)s.send_throttled);
+    ESP_LOGI(TAG, "  network time: %s, %lu beacons %s, round trip %lu us",
+             s.time_synced ? "synced" : "not synced", (unsigned long)s.time_beacons,
+             g_source == THREAD_COMMS_SOURCE_ROUTER ? "sent" : "applied", (unsigned long)s.time_rtt_us);
+    ESP_LOGI(TAG, "  time error: %lu us (drift %ld ppm), %lu slow beacons ignored, %lu latencies within their error",
+             (unsigned long)s.time_error_us, (long)s.time_drift_ppm,
+             (unsigned long)s.time_beacons_slow, (unsigned long)s.time_latency_within_error);
+    if (g_source != THREAD_COMMS_SOURCE_ROUTER) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "  children: %u/%u now (%u sleepy), peak %u, %lu joined, %lu left",
+             s.children, s.max_children, s.sleepy_children, s.children_peak,
+             (unsigned long)s.added, (unsigned long)s.removed);
+    ESP_LOGI(TAG, "  indirect queue: %u messages now, peak %u per child, %lu frames dropped",
+             s.queued, s.queued_peak, (unsigned long)s.indirect_tx_failed);
+#if CONFIG_THREAD_COMMS_RX_RATE_PER_MIN > 0
+    ESP_LOGI(TAG, "  admission: %lu admitted, %lu throttled, %u sources tracked, %lu evicted",
+             (unsigned long)s.rx_admitted, (unsigned long)s.rx_throttled, s.rx_sources,
+             (unsigned long)s.rx_evicted);
+#endif
+}
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <sys/time.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -6,10 +7,12 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_sleep.h"
+#include "esp_system.h"
 #include "esp_vfs_eventfd.h"
 #include "nvs_flash.h"
 
 #include "device_name.h"
+#include "dlog.h"
 #include "power_management.h"
 #include "sensors.h"
 #include "status.h"
@@ -24,13 +27,161 @@ static char g_device_name[32];
 /* RTC memory survives deep sleep */
 static RTC_DATA_ATTR bool g_relay_state = false;
 
+/* Set by the command handler - report the new relay state right away (acts as the ack) */
+static volatile bool g_report_requested = false;
+
 #define PM_STATS_INTERVAL_MS 60000
 
+/**
+ * Deterministic per-device delay in [0, max_ms), from the MAC.
+ * Each use gets its own salt so the offsets aren't correlated.
+ */
+static uint32_t jitter_ms(uint32_t max_ms, uint32_t salt)
+{
+    if (max_ms == 0) {
+        return 0;
+    }
+    uint32_t h = device_name_seed() ^ (salt * 0x9e3779b9u);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h % max_ms;
+}
+
+#define JITTER_BOOT   1
+#define JITTER_REPORT 2
+#define JITTER_SLEEP  3
+
+/*── Report slot ──*/
+
+/* Router-assigned report slot, kept in RTC memory. Times are RTC clock
+   microseconds (gettimeofday keeps counting through deep sleep, on the slow
+   clock); drift_ppm corrects that clock's rate against the router's. */
+static RTC_DATA_ATTR struct {
+    bool valid;
+    uint32_t slot;
+    uint32_t period_ms;
+    int64_t next_slot_us;       /* Slot start this device aims its report at */
+    int64_t anchor_us;          /* Report answered by the latest assignment */
+    int32_t drift_ppm;          /* + = local clock runs fast */
+    int32_t lead_ms;            /* Wake this long before the slot (boot, attach, sensor read) */
+} g_slot;
+
+#define SLOT_MIN_SLEEP_MS   1000
+#define SLOT_MAX_DRIFT_PPM  50000   /* RC slow clock is within a few % */
+#define SLOT_MAX_PERIOD_MS  (24 * 3600 * 1000)
+
+/* Latest assignment, applied by the main task before it sleeps */
+static thread_comms_schedule_t g_schedule;
+static volatile bool g_schedule_received = false;
+
+static int64_t rtc_now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Router duration to local RTC clock duration */
+static int64_t to_local_us(int64_t router_us)
+{
+    return router_us + router_us * g_slot.drift_ppm / 1000000;
+}
+
+/**
+ * Apply an assignment answering the report sent at report_us: its slot starts
+ * next_slot_ms (router time) after that report. The gap to where our own
+ * clock put the same slot is drift accumulated since the previous anchor.
+ * ready_ms is how long this wake took to be ready to report (boot, attach,
+ * sensor read), without the report jitter wait.
+ */
+static void slot_apply(const thread_comms_schedule_t *schedule, int64_t report_us, uint32_t ready_ms)
+{
+    int64_t next_us = report_us + to_local_us((int64_t)schedule->next_slot_ms * 1000);
+
+    if (g_slot.valid && g_slot.slot == schedule->slot && g_slot.period_ms == schedule->period_ms) {
+        int64_t period_us = to_local_us((int64_t)schedule->period_ms * 1000);
+        int64_t predicted = g_slot.next_slot_us;
+        while (predicted - next_us > period_us / 2) {
+            predicted -= period_us;
+        }
+        while (next_us - predicted > period_us / 2) {
+            predicted += period_us;
+        }
+        int64_t elapsed = next_us - g_slot.anchor_us;
+        if (elapsed > 0) {
+            /* Late prediction = local clock slow: lower the rate, half a step at a time */
+            int32_t ppm = g_slot.drift_ppm - (int32_t)((predicted - next_us) * 1000000 / elapsed / 2);
+            g_slot.drift_ppm = ppm > SLOT_MAX_DRIFT_PPM ? SLOT_MAX_DRIFT_PPM
+                             : ppm < -SLOT_MAX_DRIFT_PPM ? -SLOT_MAX_DRIFT_PPM : ppm;
+        }
+    } else {
+        g_slot.lead_ms = ready_ms;
+        g_slot.drift_ppm = 0;
+    }
+
+    g_slot.valid = true;
+    g_slot.slot = schedule->slot;
+    g_slot.period_ms = schedule->period_ms;
+    g_slot.next_slot_us = next_us;
+    g_slot.anchor_us = report_us;
+    ESP_LOGI(TAG, "Report slot %lu: every %lu ms, drift %ld ppm, lead %ld ms",
+             (unsigned long)schedule->slot, (unsigned long)schedule->period_ms,
+             (long)g_slot.drift_ppm, (long)g_slot.lead_ms);
+}
+
+/**
+ * First report of a wake went out at report_us: learn how early to wake
+ */
+static void slot_on_report(int64_t report_us)
+{
+    if (!g_slot.valid) {
+        return;
+    }
+    int64_t late_us = report_us - g_slot.next_slot_us;
+    if (late_us > (int64_t)g_slot.period_ms * 500 || -late_us > (int64_t)g_slot.period_ms * 500) {
+        return;     /* Missed the slot entirely - the router will realign us */
+    }
+    int32_t lead = g_slot.lead_ms + (int32_t)(late_us / 2000);
+    g_slot.lead_ms = lead < 0 ? 0 : lead > 10000 ? 10000 : lead;
+}
+
+/**
+ * Deep sleep until lead_ms before the next slot we can still make
+ */
+static uint32_t slot_sleep_ms(void)
+{
+    int64_t now = rtc_now_us();
+    int64_t period_us = to_local_us((int64_t)g_slot.period_ms * 1000);
+    int64_t lead_us = (int64_t)g_slot.lead_ms * 1000;
+    while (g_slot.next_slot_us - lead_us - now < SLOT_MIN_SLEEP_MS * 1000) {
+        g_slot.next_slot_us += period_us;
+    }
+    return (uint32_t)((g_slot.next_slot_us - lead_us - now) / 1000);
+}
+
 /**
  * Handle incoming relay commands from thread_comms
  */
 static void on_thread_message(const thread_comms_message_t *msg)
 {
+    if (msg->type == THREAD_COMMS_MSG_SCHEDULE) {
+        if (strcmp(msg->schedule.device_id, g_device_name) != 0) {
+            return;
+        }
+        /* slot_sleep_ms() steps by the period, and the next slot is at most
+           one and a half periods away */
+        const thread_comms_schedule_t *s = &msg->schedule;
+        if (s->period_ms < SLOT_MIN_SLEEP_MS || s->period_ms > SLOT_MAX_PERIOD_MS ||
+            s->next_slot_ms > 2 * s->period_ms) {
+            ESP_LOGW(TAG, "Ignoring report slot: period %lu ms, next in %lu ms",
+                     (unsigned long)s->period_ms, (unsigned long)s->next_slot_ms);
+            return;
+        }
+        g_schedule = *s;
+        g_schedule_received = true;
+        return;
+    }
     if (msg->type != THREAD_COMMS_MSG_RELAY_CMD) {
         return;
     }
@@ -40,16 +191,21 @@ static void on_thread_message(const thread_comms_message_t *msg)
         return;
     }
 
-    ESP_LOGI(TAG, "Received relay command: %s", msg->relay_cmd.relay_state ? "ON" : "OFF");
+    DLOGI(TAG, "Received relay command: %s", msg->relay_cmd.relay_state ? "ON" : "OFF");
     if (g_relay != NULL) {
         g_relay_state = msg->relay_cmd.relay_state;  /* Save to RTC memory */
         relay_set(g_relay, msg->relay_cmd.relay_state);
+        g_report_requested = true;
     }
 }
 
 #if CONFIG_FACTORY_RESET_BUTTON_ENABLED
-static void on_factory_reset_button(gpio_num_t gpio)
+static void on_factory_reset_button(gpio_num_t gpio, pm_wake_event_t event, uint32_t held_ms)
 {
+    if (event != PM_WAKE_EVENT_PRESS) {
+        return;
+    }
+
     ESP_LOGW(TAG, "Factory reset triggered via GPIO%d", gpio);
     nvs_flash_erase();
     pm_restart();
@@ -77,6 +233,9 @@ void app_main(void)
     };
     pm_init(&pm_cfg);
 
+    /* Deferred logging for the report/receive path */
+    dlog_init();
+
     /* NVS */
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -90,6 +249,13 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+    /* After a power cut every device boots at once - spread the attaches */
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP) {
+        uint32_t delay_ms = jitter_ms(CONFIG_BOOT_JITTER_MAX_MS, JITTER_BOOT);
+        ESP_LOGI(TAG, "Power-on: attaching in %lu ms", (unsigned long)delay_ms);
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+    }
+
     /* Thread networking and comms */
     thread_comms_set_callback(on_thread_message);
 
@@ -112,15 +278,25 @@ void app_main(void)
     #define SLEEP_MS   15000
     #define LOOP_MS    500   /* Poll interval during active period */
 
-    ESP_LOGI(TAG, "Duty cycle: %dms active, %dms sleep", ACTIVE_MS, SLEEP_MS);
+    /* With a report slot the wake is already timed - report right away */
+    uint32_t report_delay_ms = g_slot.valid ? 0 : jitter_ms(CONFIG_REPORT_JITTER_MAX_MS, JITTER_REPORT);
+    uint32_t sleep_ms = SLEEP_MS + jitter_ms(CONFIG_SLEEP_JITTER_MAX_MS, JITTER_SLEEP);
+    ESP_LOGI(TAG, "Duty cycle: %dms active (report at +%lums), %s",
+             ACTIVE_MS, (unsigned long)report_delay_ms, g_slot.valid ? "slotted" : "free-running");
 
     /* Active period - can send reports and receive commands */
     TickType_t active_start = xTaskGetTickCount();
     bool report_sent = false;
+    int64_t wake_report_us = 0;         /* First report of this wake (RTC time) */
+    uint32_t ready_ms = 0;              /* Boot to that report, without the jitter wait */
 
     while ((xTaskGetTickCount() - active_start) < pdMS_TO_TICKS(ACTIVE_MS)) {
-        /* Send report once per active period */
-        if (!report_sent) {
+        /* Send report once per active period (after this device's offset),
+           and again right away after a relay command */
+        bool report_due = !report_sent &&
+                          (xTaskGetTickCount() - active_start) >= pdMS_TO_TICKS(report_delay_ms);
+        if (report_due || g_report_requested) {
+            g_report_requested = false;
             sensors_read(sensors);
 
             const float *temp = sensors_get_temperature(sensors);
@@ -142,26 +318,52 @@ void app_main(void)
                 report.relay_state = *relay_state;
             }
 
+            /* Tell the router how long we keep listening, so it can time commands */
+            TickType_t elapsed = xTaskGetTickCount() - active_start;
+            report.has_listen_ms = true;
+            report.listen_ms = ACTIVE_MS - pdTICKS_TO_MS(elapsed);
+
             esp_err_t err = thread_comms_send_report(&report);
             if (err == ESP_OK) {
-                ESP_LOGI(TAG, "Sent report: temp=%.1f humidity=%.1f%% relay=%s",
+                DLOGI(TAG, "Sent report: temp=%.1f humidity=%.1f%% relay=%s",
                          temp ? *temp : 0, hum ? *hum : 0,
                          relay_state ? (*relay_state ? "ON" : "OFF") : "N/A");
+                if (!report_sent) {
+                    wake_report_us = rtc_now_us();
+                    ready_ms = (uint32_t)(esp_timer_get_time() / 1000) - (report_due ? report_delay_ms : 0);
+                    slot_on_report(wake_report_us);
+                }
                 report_sent = true;
             } else {
                 ESP_LOGW(TAG, "Failed to send report: %s", esp_err_to_name(err));
             }
         }
 
-        /* Stay active to receive commands */
-        vTaskDelay(pdMS_TO_TICKS(LOOP_MS));
+        /* Stay active to receive commands; wake for the report offset */
+        TickType_t wait = pdMS_TO_TICKS(LOOP_MS);
+        TickType_t since_start = xTaskGetTickCount() - active_start;
+        if (!report_sent && since_start < pdMS_TO_TICKS(report_delay_ms) &&
+            pdMS_TO_TICKS(report_delay_ms) - since_start < wait) {
+            wait = pdMS_TO_TICKS(report_delay_ms) - since_start;
+        }
+        vTaskDelay(wait);
+    }
+
+    /* Align the next wake with the report slot, if the router assigned one */
+    if (g_schedule_received && report_sent) {
+        slot_apply(&g_schedule, wake_report_us, ready_ms);
+    }
+    if (g_slot.valid) {
+        sleep_ms = slot_sleep_ms();
     }
 
     /* Shutdown Thread gracefully */
-    ESP_LOGI(TAG, "Active period ended, entering deep sleep...");
+    ESP_LOGI(TAG, "Active period ended, entering deep sleep for %lu ms...", (unsigned long)sleep_ms);
+    thread_comms_log_stats();
+    dlog_flush();  /* Pending records would be lost in deep sleep */
     thread_comms_deinit();
 
     /* Enter deep sleep */
-    pm_deep_sleep_for(SLEEP_MS);
+    pm_deep_sleep_for(sleep_ms);
     /* Never reached - device resets on wake */
 }
@@ -0,0 +1,69 @@
+#include "alloc_counter.hpp"
+
+#if CONFIG_BRIDGE_ALLOC_CHECK
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+
+#define COUNTER_SLOTS 4
+
+static struct {
+    TaskHandle_t task;          // nullptr = free
+    volatile uint32_t count;
+} s_slots[COUNTER_SLOTS];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+AllocCounter::AllocCounter()
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < COUNTER_SLOTS; i++) {
+        if (!s_slots[i].task) {
+            s_slots[i].count = 0;
+            s_slots[i].task = self;
+            slot_ = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+AllocCounter::~AllocCounter()
+{
+    if (slot_ < 0) return;
+    portENTER_CRITICAL(&s_mux);
+    s_slots[slot_].task = nullptr;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+uint32_t AllocCounter::count() const
+{
+    return slot_ >= 0 ? s_slots[slot_].count : 0;
+}
+
+// Called by heap_caps_* after every successful allocation (kept in IRAM like
+// the allocator). Only the owning task increments its slot, so no lock is needed.
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (!self) return;  // Before the scheduler starts
+    for (int i = 0; i < COUNTER_SLOTS; i++) {
+        if (s_slots[i].task == self) {
+            s_slots[i].count = s_slots[i].count + 1;
+        }
+    }
+}
+
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void *ptr)
+{
+}
+
+#else
+
+AllocCounter::AllocCounter() {}
+AllocCounter::~AllocCounter() {}
+uint32_t AllocCounter::count() const { return 0; }
+
+#endif // CONFIG_BRIDGE_ALLOC_CHECK
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+// Counts heap allocations made by the current task while in scope, through
+// the ESP-IDF heap allocation hook (CONFIG_BRIDGE_ALLOC_CHECK selects
+// CONFIG_HEAP_USE_HOOKS). Without it count() stays 0. Scopes may nest; a few
+// tasks can count at once - further counters stay at 0.
+class AllocCounter {
+public:
+    AllocCounter();
+    ~AllocCounter();
+    AllocCounter(const AllocCounter&) = delete;
+    AllocCounter& operator=(const AllocCounter&) = delete;
+
+    uint32_t count() const;
+
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    static constexpr bool enabled() { return true; }
+#else
+    static constexpr bool enabled() { return false; }
+#endif
+
+private:
+    int slot_ = -1;
+};
+
+#if CONFIG_BRIDGE_ALLOC_CHECK
+// Report path accounting: the steady state (known device, endpoints up) must not allocate
+struct ReportPathStats {
+    uint32_t reports = 0;
+    uint32_t steady = 0;
+    uint32_t steady_allocating = 0;
+    uint32_t allocs = 0;
+    uint64_t cycles = 0;        // In on_report
+};
+#endif
@@ -0,0 +1,86 @@
+#include "bridge_delivery.hpp"
+
+#include "esp_log.h"
+#include "dlog.h"
+
+static const char *TAG = "tr-delivery";
+
+void DeliveryTracker::on_message(DeliveryState &s, uint32_t epoch, uint32_t seq)
+{
+    if (seq == 0) {
+        stats_.unnumbered++;
+        return;
+    }
+
+    if (s.highest != 0 && epoch != s.epoch && epoch == s.prev_epoch) {
+        stats_.too_late++;
+        return;
+    }
+
+    if (s.highest == 0 || epoch != s.epoch) {
+        if (s.highest == 0) {
+            // First message seen: nothing below it is expected (counts as duplicate)
+            s.window = ~0u;
+        } else {
+            // The device reset and counts from 1 again; numbers below this one
+            // are lost until they turn up late
+            uint32_t skipped = seq - 1;
+            s.restarts++;
+            stats_.restarts++;
+            s.lost += skipped;
+            stats_.lost += skipped;
+            s.window = skipped >= WINDOW ? 0 : ~0u << skipped;
+            DLOGI(TAG, "Sequence restarted at %lu (was %lu)", (unsigned long)seq, (unsigned long)s.highest);
+        }
+        s.prev_epoch = s.epoch;
+        s.epoch = epoch;
+        s.highest = seq;
+        s.received++;
+        stats_.received++;
+        return;
+    }
+
+    if (seq > s.highest) {
+        uint32_t ahead = seq - s.highest;
+        uint32_t skipped = ahead - 1;
+        s.lost += skipped;
+        stats_.lost += skipped;
+        s.window = ahead > WINDOW ? 0 : ((ahead == WINDOW ? 0 : s.window << ahead) | (1u << (ahead - 1)));
+        s.highest = seq;
+        s.received++;
+        stats_.received++;
+        return;
+    }
+
+    if (s.highest - seq > WINDOW) {
+        stats_.too_late++;      // Can't tell late from repeated any more
+        return;
+    }
+
+    uint32_t bit = seq == s.highest ? WINDOW : s.highest - seq - 1;
+    if (bit == WINDOW || (s.window & (1u << bit))) {
+        s.duplicates++;
+        stats_.duplicates++;
+        return;
+    }
+
+    // Late: fills a gap counted as lost when the higher number arrived
+    s.window |= 1u << bit;
+    s.reordered++;
+    s.lost--;
+    s.received++;
+    stats_.reordered++;
+    stats_.lost--;
+    stats_.received++;
+}
+
+void DeliveryTracker::log_stats() const
+{
+    uint32_t expected = stats_.received + stats_.lost;
+    uint32_t pdr = expected ? static_cast<uint32_t>(static_cast<uint64_t>(stats_.received) * 1000 / expected) : 1000;
+    ESP_LOGI(TAG, "Delivery: %lu received, %lu lost, PDR %lu.%lu%%; %lu duplicates, %lu reordered, %lu too late, "
+                  "%lu restarts, %lu unnumbered",
+             (unsigned long)stats_.received, (unsigned long)stats_.lost, (unsigned long)(pdr / 10),
+             (unsigned long)(pdr % 10), (unsigned long)stats_.duplicates, (unsigned long)stats_.reordered,
+             (unsigned long)stats_.too_late, (unsigned long)stats_.restarts, (unsigned long)stats_.unnumbered);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// Delivery accounting of one device's messages, kept in BridgeDevice.
+// Devices number their messages (thread_comms seq, from 1, kept in RTC
+// memory across deep sleep), so a missing number is a lost message rather
+// than a quiet device. A 32-message window behind the highest number seen
+// tells late arrivals (reordered) from repeats (duplicates). The count starts
+// over when the sender's power-on epoch changes.
+struct DeliveryState {
+    uint32_t epoch = 0;         // Sender's power-on epoch of the current count
+    uint32_t prev_epoch = 0;    // The one before (its late messages are ignored)
+    uint32_t highest = 0;       // Highest sequence number seen (0 = none yet)
+    uint32_t window = 0;        // Bit i: highest - 1 - i was received
+    uint32_t received = 0;      // Distinct messages
+    uint32_t lost = 0;          // Skipped numbers not (yet) received
+    uint16_t duplicates = 0;
+    uint16_t reordered = 0;     // Arrived after a higher number (filled a gap)
+    uint16_t restarts = 0;      // New epoch (sender reset other than deep sleep)
+
+    // Packet delivery ratio in 0.1% (1000 = nothing lost)
+    uint32_t pdr_permille() const
+    {
+        uint32_t expected = received + lost;
+        return expected ? static_cast<uint32_t>(static_cast<uint64_t>(received) * 1000 / expected) : 1000;
+    }
+};
+
+// Updates DeliveryState from received sequence numbers and keeps fleet totals.
+// Messages dropped before on_message() (router admission control, full bridge
+// event queue) count as lost - they are on the bridge's own counters too.
+class DeliveryTracker {
+public:
+    // seq = 0 (sender does not number its messages) is ignored
+    void on_message(DeliveryState &s, uint32_t epoch, uint32_t seq);
+
+    void log_stats() const;
+
+private:
+    static constexpr uint32_t WINDOW = 32;
+
+    struct Stats {
+        uint32_t received = 0;
+        uint32_t lost = 0;          // Net of late arrivals
+        uint32_t duplicates = 0;
+        uint32_t reordered = 0;
+        uint32_t restarts = 0;
+        uint32_t unnumbered = 0;    // Messages without a sequence number
+        uint32_t too_late = 0;      // Behind the window or from before a restart (ignored)
+    };
+    Stats stats_;
+};
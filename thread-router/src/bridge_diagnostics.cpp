@@ -0,0 +1,448 @@
+#include "bridge_diagnostics.hpp"
+
+#if CONFIG_BRIDGE_DIAGNOSTICS
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#include "bridge_index.hpp"
+#include "bridge_nvs.hpp"
+
+static const char *TAG = "tr-diag";
+
+static BridgeDiagnosticsHooks s_hooks;
+
+/*── Device lookups ──*/
+
+#if CONFIG_BRIDGE_INDEX_BENCHMARK
+
+#define BENCH_ID_LEN    18      // Same as BridgeNvsDevice.device_id
+#define BENCH_LOOKUPS   1000
+
+static void index_benchmark()
+{
+    static const size_t sizes[] = { 10, 100, 1000, 10000 };
+
+    ESP_LOGI(TAG, "Lookup benchmark (%d lookups per size)", BENCH_LOOKUPS);
+
+    for (size_t n : sizes) {
+        // Pool of ids + index table (2x next power of two, 8 bytes per entry)
+        size_t needed = n * BENCH_ID_LEN + n * 2 * 2 * sizeof(uint64_t) + 16 * 1024;
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < needed) {
+            ESP_LOGW(TAG, "  n=%u: skipped (not enough free heap)", (unsigned)n);
+            continue;
+        }
+
+        char *ids = static_cast<char *>(malloc(n * BENCH_ID_LEN));
+        if (!ids) continue;
+        for (size_t i = 0; i < n; i++) {
+            snprintf(&ids[i * BENCH_ID_LEN], BENCH_ID_LEN, "bench-falcon-%04x", (unsigned)i);
+        }
+
+        SlotIndex index;
+        for (size_t i = 0; i < n; i++) {
+            index.insert(bridge_hash_device_id(&ids[i * BENCH_ID_LEN]), static_cast<uint16_t>(i));
+        }
+
+        volatile uint32_t sink = 0;
+
+        // Linear scan (previous find_by_device_id)
+        int64_t start = esp_timer_get_time();
+        for (size_t k = 0; k < BENCH_LOOKUPS; k++) {
+            const char *key = &ids[((k * 7919) % n) * BENCH_ID_LEN];
+            for (size_t i = 0; i < n; i++) {
+                if (strcmp(&ids[i * BENCH_ID_LEN], key) == 0) {
+                    sink = sink + i;
+                    break;
+                }
+            }
+        }
+        int64_t linear_us = esp_timer_get_time() - start;
+
+        // Hash index
+        index.reset_stats();
+        start = esp_timer_get_time();
+        for (size_t k = 0; k < BENCH_LOOKUPS; k++) {
+            const char *key = &ids[((k * 7919) % n) * BENCH_ID_LEN];
+            sink = sink + index.find(bridge_hash_device_id(key), [&](uint16_t slot) {
+                return strcmp(&ids[slot * BENCH_ID_LEN], key) == 0;
+            });
+        }
+        int64_t index_us = esp_timer_get_time() - start;
+
+        ESP_LOGI(TAG, "  n=%5u: linear %6lld ns/lookup, index %5lld ns/lookup (capacity %u, %lu.%02lu probes)",
+                 (unsigned)n,
+                 (long long)(linear_us * 1000 / BENCH_LOOKUPS),
+                 (long long)(index_us * 1000 / BENCH_LOOKUPS),
+                 (unsigned)index.capacity(),
+                 (unsigned long)(index.avg_probes_x100() / 100),
+                 (unsigned long)(index.avg_probes_x100() % 100));
+
+        free(ids);
+    }
+}
+
+#endif // CONFIG_BRIDGE_INDEX_BENCHMARK
+
+/*── Store ──*/
+
+#if CONFIG_BRIDGE_STORE_BENCHMARK
+
+#define BENCH_UPDATE_ROUNDS 3
+
+#if CONFIG_BRIDGE_STORE_LOG
+#define BENCH_BACKEND "log"
+#else
+#define BENCH_BACKEND "nvs"
+#endif
+
+// Uses only the public API, so it measures whichever backend is selected
+static void store_benchmark()
+{
+    static const size_t sizes[] = { 100, 1000 };
+
+    ESP_LOGW(TAG, "Store benchmark (%s) - erasing bridge data", BENCH_BACKEND);
+
+    for (size_t n : sizes) {
+        bridge_nvs_erase_all();
+        BridgeNvsStats before = bridge_nvs_get_stats();
+
+        // Initial records (as for new devices: saved and committed one by one)
+        BridgeDeviceState device;
+        size_t saved = 0;
+        for (size_t i = 0; i < n; i++) {
+            char id[BRIDGE_DEVICE_ID_LEN];
+            snprintf(id, sizeof(id), "bench-falcon-%04x", (unsigned)i);
+            device.set_device_id(id);
+            device.plug_endpoint_id = static_cast<uint16_t>(3 * i + 1);
+            device.temp_endpoint_id = static_cast<uint16_t>(3 * i + 2);
+            device.humidity_endpoint_id = static_cast<uint16_t>(3 * i + 3);
+            device.set_temperature(20.0f);
+            device.set_humidity(50.0f);
+            device.set_relay_state(false);
+            if (bridge_nvs_save_device(device) != ESP_OK) break;
+            saved++;
+        }
+        if (saved < n) {
+            ESP_LOGW(TAG, "  n=%u: store full after %u devices", (unsigned)n, (unsigned)saved);
+        }
+
+        // Sensor updates (as for write-behind flushes: one commit per round)
+        for (int round = 0; round < BENCH_UPDATE_ROUNDS; round++) {
+            for (size_t i = 0; i < saved; i++) {
+                char id[BRIDGE_DEVICE_ID_LEN];
+                snprintf(id, sizeof(id), "bench-falcon-%04x", (unsigned)i);
+                device.set_device_id(id);
+                device.plug_endpoint_id = static_cast<uint16_t>(3 * i + 1);
+                device.temp_endpoint_id = static_cast<uint16_t>(3 * i + 2);
+                device.humidity_endpoint_id = static_cast<uint16_t>(3 * i + 3);
+                device.set_temperature(20.0f + round);
+                bridge_nvs_save_device(device, false);
+            }
+            bridge_nvs_commit();
+        }
+
+        // Boot restore
+        int64_t start = esp_timer_get_time();
+        auto devices = bridge_nvs_load_all_devices();
+        int64_t restore_us = esp_timer_get_time() - start;
+
+        const BridgeNvsStats &after = bridge_nvs_get_stats();
+        uint32_t payload = after.payload_bytes - before.payload_bytes;
+        uint32_t flash = (after.bytes - before.bytes) + (after.compaction_bytes - before.compaction_bytes);
+
+        ESP_LOGI(TAG, "  n=%4u: restore %zu devices in %lld us, %lu writes, %lu payload bytes, "
+                 "%lu flash bytes (%lu.%02lux), %lu compactions",
+                 (unsigned)n, devices.size(), (long long)restore_us,
+                 (unsigned long)(after.writes - before.writes), (unsigned long)payload,
+                 (unsigned long)flash,
+                 (unsigned long)(payload ? flash / payload : 0),
+                 (unsigned long)(payload ? (flash * 100ULL / payload) % 100 : 0),
+                 (unsigned long)(after.compactions - before.compactions));
+    }
+
+    bridge_nvs_erase_all();
+}
+
+#endif // CONFIG_BRIDGE_STORE_BENCHMARK
+
+/*── Provisioning burst ──*/
+
+#if CONFIG_BRIDGE_PROVISION_BENCHMARK
+
+#define BENCH_EXISTING  4       // Already provisioned devices whose reports are timed
+#define BENCH_NEW       50      // New devices in the burst
+#define BENCH_BASELINE  20      // Timed reports before the burst
+
+static void bench_report(BridgeEvent &event, const char *fmt, unsigned i)
+{
+    event = {};
+    event.type = BridgeEventType::REPORT;
+    snprintf(event.report.device_id, BRIDGE_DEVICE_ID_LEN, fmt, i);
+    event.report.has_temperature = true;
+    event.report.temperature = 20.0f + (i % 10);
+    event.report.has_humidity = true;
+    event.report.humidity = 40.0f + (i % 10);
+    event.report.has_relay_state = true;
+    event.report.relay_state = false;
+}
+
+// Report from an existing device; returns post-to-handled time (us), -1 on timeout
+static int64_t bench_existing_report(BridgeEventQueue &events, unsigned i)
+{
+    BridgeEvent event;
+    bench_report(event, "bench-old-%02u", i % BENCH_EXISTING);
+    int64_t start = esp_timer_get_time();
+    if (!events.post_and_wait(event, pdMS_TO_TICKS(5000))) {
+        return -1;
+    }
+    return esp_timer_get_time() - start;
+}
+
+static void bench_log(const char *name, const LatencyHistogram &hist)
+{
+    ESP_LOGI(TAG, "  %s (n=%lu): p50 <%lu us, p90 <%lu us, p99 <%lu us, max %lu us",
+             name, (unsigned long)hist.count(), (unsigned long)hist.percentile(50),
+             (unsigned long)hist.percentile(90), (unsigned long)hist.percentile(99),
+             (unsigned long)hist.max());
+}
+
+static void provision_benchmark(BridgeEventQueue &events)
+{
+    ESP_LOGW(TAG, "Provisioning benchmark: %d existing + %d new synthetic devices (persisted - erase bridge data afterwards)",
+             BENCH_EXISTING, BENCH_NEW);
+
+    BridgeEvent event;
+    for (unsigned i = 0; i < BENCH_EXISTING; i++) {
+        bench_report(event, "bench-old-%02u", i);
+        events.post(event, portMAX_DELAY);
+    }
+    for (unsigned i = 0; i < BENCH_EXISTING; i++) {
+        bench_report(event, "bench-old-%02u", i);
+        if (!events.wait_device_ready(event.report.device_id, pdMS_TO_TICKS(30000))) {
+            ESP_LOGE(TAG, "Provisioning benchmark: '%s' has no endpoints after 30 s - skipped",
+                     event.report.device_id);
+            return;
+        }
+    }
+
+    LatencyHistogram baseline;
+    for (unsigned i = 0; i < BENCH_BASELINE; i++) {
+        int64_t us = bench_existing_report(events, i);
+        if (us >= 0) baseline.record(static_cast<uint32_t>(us));
+    }
+
+    // Every new device's first report is followed by a timed report from an existing one
+    LatencyHistogram burst;
+    uint32_t timeouts = 0;
+    int64_t start = esp_timer_get_time();
+    for (unsigned i = 0; i < BENCH_NEW; i++) {
+        bench_report(event, "bench-new-%02u", i);
+        events.post(event, portMAX_DELAY);
+        int64_t us = bench_existing_report(events, i);
+        if (us >= 0) {
+            burst.record(static_cast<uint32_t>(us));
+        } else {
+            timeouts++;
+        }
+    }
+
+    ESP_LOGI(TAG, "Existing-device report latency (post to handled):");
+    bench_log("idle", baseline);
+    bench_log("during burst", burst);
+    ESP_LOGI(TAG, "  burst queued in %lld ms, %lu timeouts; endpoint creation continues on the worker",
+             (long long)(esp_timer_get_time() - start) / 1000, (unsigned long)timeouts);
+}
+
+#endif // CONFIG_BRIDGE_PROVISION_BENCHMARK
+
+/*── Report path ──*/
+
+#if CONFIG_BRIDGE_REPORT_BENCHMARK
+
+#define BENCH_REPORTS 1000
+
+// Wait until the bridge task has handled everything queued so far
+static void bridge_sync()
+{
+    BridgeEvent event = {};
+    event.type = BridgeEventType::SYNC;
+    s_hooks.events->post_and_wait(event, pdMS_TO_TICKS(5000));
+}
+
+// Steady-state reports from one synthetic device, fed through the Thread callback
+static void report_benchmark()
+{
+    thread_comms_message_t msg = {};
+    msg.type = THREAD_COMMS_MSG_REPORT;
+    strlcpy(msg.report.device_id, "bench-report", sizeof(msg.report.device_id));
+    msg.report.has_temperature = true;
+    msg.report.temperature = 20.0f;
+    msg.report.has_humidity = true;
+    msg.report.humidity = 45.0f;
+    msg.report.has_relay_state = true;
+    msg.report.relay_state = false;
+
+    // The first report creates the device; wait for its endpoints
+    s_hooks.on_message(&msg);
+    if (!s_hooks.events->wait_device_ready(msg.report.device_id, pdMS_TO_TICKS(30000))) {
+        ESP_LOGE(TAG, "Report benchmark: '%s' has no endpoints after 30 s - skipped", msg.report.device_id);
+        return;
+    }
+
+    ReportPathStats before = *s_hooks.report_stats;
+    uint32_t callback_allocs = *s_hooks.callback_allocs;
+    uint64_t callback_cycles = 0;
+    for (int i = 0; i < BENCH_REPORTS; i++) {
+        msg.report.temperature = 20.0f + (i % 50) * 0.1f;     // Crosses the publish epsilon
+        uint32_t start = esp_cpu_get_cycle_count();
+        s_hooks.on_message(&msg);
+        callback_cycles += esp_cpu_get_cycle_count() - start;
+        if (i % 8 == 7) {
+            bridge_sync();  // Stay below the queue length
+        }
+    }
+    bridge_sync();
+
+    uint32_t reports = s_hooks.report_stats->reports - before.reports;
+    uint32_t allocs = (s_hooks.report_stats->allocs - before.allocs) + (*s_hooks.callback_allocs - callback_allocs);
+    uint32_t ticks_per_us = esp_rom_get_cpu_ticks_per_us();
+    ESP_LOGI(TAG, "Report benchmark: %lu reports, %lu ns/report in on_thread_message, %lu ns/report in on_report",
+             (unsigned long)reports,
+             (unsigned long)(callback_cycles * 1000 / ticks_per_us / BENCH_REPORTS),
+             (unsigned long)(reports ? (s_hooks.report_stats->cycles - before.cycles) * 1000 / ticks_per_us / reports : 0));
+    ESP_LOGI(TAG, "  %lu.%03lu heap allocations/report - %s",
+             (unsigned long)(allocs / BENCH_REPORTS), (unsigned long)(allocs * 1000 / BENCH_REPORTS % 1000),
+             allocs ? "FAIL (steady-state path allocates)" : "PASS");
+}
+
+#endif // CONFIG_BRIDGE_REPORT_BENCHMARK
+
+/*── Message buffers ──*/
+
+#if CONFIG_BRIDGE_BUFFER_BENCHMARK
+
+#define BENCH_FLEET         200     // Devices restarting at once
+#define BENCH_CMD_EVERY     8       // ...of which every 8th has a pending relay command
+
+// Buffer headroom while the bridge answers a fleet restart (Thread must be up)
+static void buffer_benchmark()
+{
+    thread_comms_stats_t s;
+    thread_comms_get_stats(&s);
+    uint16_t idle_free = s.buf_free;
+    uint32_t throttled = s.send_throttled;
+    uint32_t no_bufs = s.send_no_bufs;
+    uint16_t min_free = idle_free;
+
+    uint32_t schedules = 0, schedules_refused = 0, commands = 0, commands_refused = 0;
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < BENCH_FLEET; i++) {
+        thread_comms_schedule_t schedule = {};
+        snprintf(schedule.device_id, sizeof(schedule.device_id), "bench-fleet-%03d", i);
+        schedule.period_ms = CONFIG_BRIDGE_SLOT_PERIOD_MS;
+        schedule.next_slot_ms = CONFIG_BRIDGE_SLOT_PERIOD_MS;
+        schedule.slot = i % CONFIG_BRIDGE_SLOT_COUNT;
+        schedules++;
+        if (thread_comms_send_schedule(&schedule) != ESP_OK) {
+            schedules_refused++;
+        }
+
+        if (i % BENCH_CMD_EVERY == 0) {
+            thread_comms_relay_cmd_t cmd = {};
+            strlcpy(cmd.device_id, schedule.device_id, sizeof(cmd.device_id));
+            cmd.relay_state = true;
+            commands++;
+            if (thread_comms_send_relay_cmd(&cmd) != ESP_OK) {
+                commands_refused++;
+            }
+        }
+
+        thread_comms_get_stats(&s);
+        if (s.buf_free < min_free) {
+            min_free = s.buf_free;
+        }
+    }
+    int64_t sent_us = esp_timer_get_time();
+
+    // Recovery: until the pool is back to its idle level (indirect copies
+    // for sleepy children drain at their poll period)
+    while (s.buf_free < idle_free && esp_timer_get_time() - sent_us < 60 * 1000000LL) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        thread_comms_get_stats(&s);
+    }
+    int64_t drained_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Buffer benchmark: %d devices, %lu assignments + %lu commands sent in %lld ms",
+             BENCH_FLEET, (unsigned long)schedules, (unsigned long)commands, (long long)(sent_us - start_us) / 1000);
+    ESP_LOGI(TAG, "  buffers: %u/%u free idle, %u at the lowest, low-water since boot %u; drained in %lld ms%s",
+             idle_free, s.buf_total, min_free, s.buf_free_min, (long long)(drained_us - sent_us) / 1000,
+             s.buf_free < idle_free ? " (not fully)" : "");
+    ESP_LOGI(TAG, "  refused: %lu assignments, %lu commands (%lu throttled, %lu out of buffers) - %s",
+             (unsigned long)schedules_refused, (unsigned long)commands_refused,
+             (unsigned long)(s.send_throttled - throttled), (unsigned long)(s.send_no_bufs - no_bufs),
+             commands_refused ? "FAIL (relay command reserve exhausted)" : "PASS");
+}
+
+#endif // CONFIG_BRIDGE_BUFFER_BENCHMARK
+
+/*── Entry point ──*/
+
+#if CONFIG_BRIDGE_PROVISION_BENCHMARK || CONFIG_BRIDGE_REPORT_BENCHMARK || CONFIG_BRIDGE_BUFFER_BENCHMARK
+#define DIAGNOSTICS_TASK 1
+#endif
+
+#if DIAGNOSTICS_TASK
+// Benchmarks that need the bridge task (and Thread, for the buffer one)
+static void diagnostics_task(void *arg)
+{
+    // Handled once the bridge task runs
+    BridgeEvent event = {};
+    event.type = BridgeEventType::SYNC;
+    s_hooks.events->post_and_wait(event, portMAX_DELAY);
+
+#if CONFIG_BRIDGE_PROVISION_BENCHMARK
+    provision_benchmark(*s_hooks.events);
+#endif
+#if CONFIG_BRIDGE_REPORT_BENCHMARK
+    report_benchmark();
+#endif
+#if CONFIG_BRIDGE_BUFFER_BENCHMARK
+    while (*s_hooks.thread_ready_us == 0) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    buffer_benchmark();
+#endif
+    ESP_LOGI(TAG, "Diagnostics done");
+    vTaskDelete(NULL);
+}
+#endif
+
+void bridge_diagnostics_start(const BridgeDiagnosticsHooks &hooks)
+{
+    s_hooks = hooks;
+
+#if CONFIG_BRIDGE_INDEX_BENCHMARK
+    index_benchmark();
+#endif
+#if CONFIG_BRIDGE_STORE_BENCHMARK
+    store_benchmark();
+#endif
+
+#if DIAGNOSTICS_TASK
+    if (xTaskCreate(diagnostics_task, "diag", 8192, NULL, 3, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create diagnostics task");
+    }
+#endif
+}
+
+#endif // CONFIG_BRIDGE_DIAGNOSTICS
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+#if CONFIG_BRIDGE_DIAGNOSTICS
+
+#include "alloc_counter.hpp"
+#include "bridge_events.hpp"
+
+extern "C" {
+#include "thread_comms.h"
+}
+
+// What the diagnostics need from app_main. Pointers must stay valid for the
+// life of the firmware (statics).
+struct BridgeDiagnosticsHooks {
+    BridgeEventQueue *events;                   // The bridge task's queue
+    thread_comms_callback_t on_message;         // The router's Thread callback
+    volatile int64_t *thread_ready_us;          // Nonzero once Thread comms is up
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    const ReportPathStats *report_stats;        // Bridge task's report path accounting
+    volatile uint32_t *callback_allocs;         // ...and the Thread callback's
+#endif
+};
+
+// Boot benchmarks, each enabled by its own CONFIG_BRIDGE_*_BENCHMARK option.
+// Call once, after bridge_nvs_init() and before Matter starts: the index and
+// store benchmarks run right away (the store one erases bridge data before
+// the bridge loads it). A diagnostics task then waits for the bridge task and
+// Thread and runs the provisioning, report and buffer benchmarks.
+void bridge_diagnostics_start(const BridgeDiagnosticsHooks &hooks);
+
+#endif
@@ -0,0 +1,233 @@
+#include "bridge_dispatch.hpp"
+
+#include "esp_log.h"
+
+static const char *TAG = "tr-dispatch";
+
+// Signed difference of two wrapping ms timestamps
+static inline int32_t ms_diff(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b);
+}
+
+void LatencyHistogram::record(uint32_t value)
+{
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && value >= (1u << bucket)) {
+        bucket++;
+    }
+    buckets_[bucket]++;
+    count_++;
+    if (value > max_) {
+        max_ = value;
+    }
+}
+
+uint32_t LatencyHistogram::percentile(uint32_t pct) const
+{
+    if (count_ == 0) return 0;
+
+    uint32_t target = (count_ * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            uint32_t bound = 1u << i;
+            return (i == BUCKETS - 1 || bound > max_) ? max_ : bound;
+        }
+    }
+    return max_;
+}
+
+void SmallLatencyHistogram::record(uint32_t value)
+{
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && value >= (1u << bucket)) {
+        bucket++;
+    }
+    if (buckets_[bucket] == UINT16_MAX) {
+        for (auto &b : buckets_) {
+            b /= 2;
+        }
+    }
+    buckets_[bucket]++;
+    if (value > max_) {
+        max_ = value;
+    }
+}
+
+uint32_t SmallLatencyHistogram::count() const
+{
+    uint32_t n = 0;
+    for (auto b : buckets_) {
+        n += b;
+    }
+    return n;
+}
+
+uint32_t SmallLatencyHistogram::percentile(uint32_t pct) const
+{
+    uint32_t n = count();
+    if (n == 0) return 0;
+
+    uint32_t target = (n * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            uint32_t bound = 1u << i;
+            return (i == BUCKETS - 1 || bound > max_) ? max_ : bound;
+        }
+    }
+    return max_;
+}
+
+bool CommandDispatcher::observe_report(CommandSchedule &s, const thread_comms_report_t *report, uint32_t now_ms)
+{
+    s.sleepy = report->has_listen_ms;
+    if (!s.sleepy) return false;
+
+    // Reports inside an open window (e.g. command acks) don't start a new wake
+    bool new_wake = s.wake_ms == 0 || ms_diff(now_ms, s.listen_until_ms) > 0;
+    if (new_wake) {
+        if (s.wake_ms != 0) {
+            uint32_t interval = now_ms - s.wake_ms;
+            s.period_ms = s.period_ms ? s.period_ms + static_cast<int32_t>(interval - s.period_ms) / 4 : interval;
+        }
+        s.wake_ms = now_ms;
+    }
+    s.listen_until_ms = now_ms + report->listen_ms;
+    return new_wake;
+}
+
+bool CommandDispatcher::on_write(CommandSchedule &s, bool desired, uint32_t now_ms)
+{
+    stats_.writes++;
+    if (s.state == ReconcileState::PENDING) {
+        stats_.coalesced++;
+    }
+    s.desired = desired;
+    s.written_ms = now_ms;
+
+    if (s.has_reported && s.reported == desired) {
+        stats_.already++;
+        s.state = ReconcileState::IN_SYNC;
+        return false;
+    }
+
+    s.state = ReconcileState::PENDING;
+    s.attempts = 0;
+    s.next_send_ms = now_ms;
+    s.deadline_ms = now_ms + CONFIG_BRIDGE_CMD_DEADLINE_S * 1000;
+    return true;
+}
+
+bool CommandDispatcher::on_report(CommandSchedule &s, bool relay_state, uint32_t now_ms)
+{
+    s.reported = relay_state;
+    s.has_reported = true;
+
+    switch (s.state) {
+        case ReconcileState::IN_SYNC:
+            s.desired = relay_state;    // Changed at the device
+            return false;
+
+        case ReconcileState::PENDING:
+            if (relay_state != s.desired) {
+                s.next_send_ms = now_ms;    // It is listening right now
+                return false;
+            }
+            stats_.confirmed++;
+            (s.sleepy ? converge_sleepy_ : converge_rx_on_).record(now_ms - s.written_ms);
+            break;
+
+        case ReconcileState::UNCONFIRMED:
+            if (relay_state == s.desired) {
+                stats_.late++;
+            }
+            break;
+    }
+
+    // Any report ends PENDING/UNCONFIRMED once it matches; after the deadline the device's state wins
+    s.desired = relay_state;
+    s.state = ReconcileState::IN_SYNC;
+    return true;
+}
+
+CommandDispatcher::Action CommandDispatcher::on_timer(CommandSchedule &s, uint32_t now_ms)
+{
+    if (s.state != ReconcileState::PENDING) return Action::NONE;
+
+    if (ms_diff(now_ms, s.deadline_ms) >= 0) {
+        s.state = ReconcileState::UNCONFIRMED;
+        stats_.unconfirmed++;
+        return Action::EXPIRE;
+    }
+
+    uint32_t due = next_send_ms(s, now_ms);
+    if (due != NEVER && ms_diff(due, now_ms) <= 0) {
+        return Action::SEND;
+    }
+    return Action::NONE;
+}
+
+void CommandDispatcher::on_sent(CommandSchedule &s, uint32_t now_ms)
+{
+    stats_.sends++;
+    s.attempts++;
+    s.next_send_ms = now_ms + CONFIG_BRIDGE_CMD_RETRY_MS;
+}
+
+uint32_t CommandDispatcher::next_timer_ms(const CommandSchedule &s, uint32_t now_ms) const
+{
+    if (s.state != ReconcileState::PENDING) return NEVER;
+
+    uint32_t due = next_send_ms(s, now_ms);
+    if (due == NEVER || ms_diff(due, s.deadline_ms) > 0) {
+        return s.deadline_ms;
+    }
+    return due;
+}
+
+uint32_t CommandDispatcher::next_send_ms(const CommandSchedule &s, uint32_t now_ms) const
+{
+    if (!s.sleepy) return s.next_send_ms;
+
+    // Listen window still open (with margin for the trip)
+    if (ms_diff(s.listen_until_ms, now_ms) > CONFIG_BRIDGE_CMD_WAKE_GUARD_MS) {
+        return s.next_send_ms;
+    }
+    if (s.period_ms == 0) return NEVER;
+
+    // Next predicted wake, plus time for the device to attach and start listening
+    uint32_t wake = s.wake_ms + s.period_ms;
+    while (ms_diff(wake + CONFIG_BRIDGE_CMD_WAKE_GUARD_MS, now_ms) <= 0) {
+        wake += s.period_ms;
+    }
+    uint32_t due = wake + CONFIG_BRIDGE_CMD_WAKE_GUARD_MS;
+    return ms_diff(due, s.next_send_ms) > 0 ? due : s.next_send_ms;
+}
+
+void CommandDispatcher::log_stats() const
+{
+    ESP_LOGI(TAG, "Relay reconcile: %lu writes (%lu coalesced, %lu already in sync), %lu sends",
+             (unsigned long)stats_.writes, (unsigned long)stats_.coalesced, (unsigned long)stats_.already,
+             (unsigned long)stats_.sends);
+    ESP_LOGI(TAG, "  %lu confirmed, %lu unconfirmed at deadline (%lu confirmed later)",
+             (unsigned long)stats_.confirmed, (unsigned long)stats_.unconfirmed, (unsigned long)stats_.late);
+
+    const struct {
+        const char *name;
+        const LatencyHistogram &hist;
+    } classes[] = {
+        { "rx-on", converge_rx_on_ },
+        { "sleepy", converge_sleepy_ },
+    };
+    for (const auto &c : classes) {
+        if (c.hist.count() == 0) continue;
+        ESP_LOGI(TAG, "  %s convergence (n=%lu): p50 <%lu ms, p90 <%lu ms, p99 <%lu ms, max %lu ms",
+                 c.name, (unsigned long)c.hist.count(), (unsigned long)c.hist.percentile(50),
+                 (unsigned long)c.hist.percentile(90), (unsigned long)c.hist.percentile(99),
+                 (unsigned long)c.hist.max());
+    }
+}
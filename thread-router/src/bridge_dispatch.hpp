@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+extern "C" {
+#include "thread_comms.h"
+}
+
+// Log2 latency histogram in the caller's unit (ms or us): bucket 0 counts
+// samples < 1, bucket i samples in [2^(i-1), 2^i)
+class LatencyHistogram {
+public:
+    void record(uint32_t value);
+    uint32_t count() const { return count_; }
+    uint32_t max() const { return max_; }
+    // Upper bound of the bucket holding the pct-th percentile sample, capped at max()
+    uint32_t percentile(uint32_t pct) const;
+
+private:
+    static constexpr int BUCKETS = 20;  // Last bucket also takes everything >= 2^18
+    uint32_t buckets_[BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t max_ = 0;
+};
+
+// Compact LatencyHistogram for per-device use: 12 power-of-two buckets with
+// 16-bit counts, halved together when one would overflow (recent samples
+// weigh more). 28 bytes.
+class SmallLatencyHistogram {
+public:
+    void record(uint32_t value);
+    uint32_t count() const;
+    uint32_t max() const { return max_; }
+    uint32_t percentile(uint32_t pct) const;
+
+private:
+    static constexpr int BUCKETS = 12;  // Last bucket also takes everything >= 2^10
+    uint16_t buckets_[BUCKETS] = {};
+    uint32_t max_ = 0;
+};
+
+// Relay reconciliation state (desired vs reported)
+enum class ReconcileState : uint8_t {
+    IN_SYNC,        // Reported state matches the desired one
+    PENDING,        // Desired state being sent until a report confirms it
+    UNCONFIRMED,    // Deadline passed - Matter shows the reported state until the next report
+};
+
+// Per-device relay reconciliation and command timing, kept in BridgeDevice.
+// Timestamps are low 32 bits of uptime in ms (compare with signed differences).
+struct CommandSchedule {
+    uint32_t wake_ms = 0;           // First report of the current/last wake window
+    uint32_t period_ms = 0;         // EWMA of wake-to-wake intervals (0 = not learned yet)
+    uint32_t listen_until_ms = 0;   // Sleepy device receives until then
+    uint32_t written_ms = 0;        // Latest Matter write of the desired state
+    uint32_t next_send_ms = 0;      // Earliest (re)send
+    uint32_t deadline_ms = 0;       // PENDING turns UNCONFIRMED after this
+    uint8_t attempts = 0;
+    ReconcileState state = ReconcileState::IN_SYNC;
+    bool desired = false;
+    bool reported = false;
+    bool has_reported = false;
+    bool sleepy = false;            // Reports carry a listen window
+};
+
+// Reconciles the relay state Matter asked for with the one devices report.
+// A write makes the device PENDING; the desired state is (re)sent from a
+// timer - immediately to rx-on devices, to sleepy ones while their listen
+// window is open or at their predicted next wake - until a report confirms it
+// or CONFIG_BRIDGE_CMD_DEADLINE_S passes. Newer writes replace older ones.
+class CommandDispatcher {
+public:
+    static constexpr uint32_t NEVER = UINT32_MAX;
+
+    // Learn the device class and wake schedule from a report; true if it
+    // started a new wake window of a sleepy device
+    bool observe_report(CommandSchedule &s, const thread_comms_report_t *report, uint32_t now_ms);
+
+    // Matter write; true if the device is now PENDING (arm its timer)
+    bool on_write(CommandSchedule &s, bool desired, uint32_t now_ms);
+
+    // Reported relay state; true if it ended a PENDING or UNCONFIRMED state
+    bool on_report(CommandSchedule &s, bool relay_state, uint32_t now_ms);
+
+    enum class Action : uint8_t { NONE, SEND, EXPIRE };
+    // Reconcile timer fired
+    Action on_timer(CommandSchedule &s, uint32_t now_ms);
+    void on_sent(CommandSchedule &s, uint32_t now_ms);
+
+    // When the reconcile timer should fire next (NEVER = no timer needed)
+    uint32_t next_timer_ms(const CommandSchedule &s, uint32_t now_ms) const;
+
+    void log_stats() const;
+
+private:
+    uint32_t next_send_ms(const CommandSchedule &s, uint32_t now_ms) const;
+
+    struct Stats {
+        uint32_t writes = 0;
+        uint32_t coalesced = 0;     // Writes that replaced a pending one
+        uint32_t already = 0;       // Writes the device already matched
+        uint32_t sends = 0;
+        uint32_t confirmed = 0;
+        uint32_t unconfirmed = 0;   // Deadline expired
+        uint32_t late = 0;          // Confirmed by a report after the deadline
+    };
+    Stats stats_;
+
+    // Convergence time (Matter write to confirming report), per device class
+    LatencyHistogram converge_rx_on_;
+    LatencyHistogram converge_sleepy_;
+};
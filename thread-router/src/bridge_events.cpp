@@ -0,0 +1,86 @@
+#include "bridge_events.hpp"
+
+#include <cstring>
+
+#include "esp_log.h"
+
+static const char *TAG = "tr-events";
+
+esp_err_t BridgeEventQueue::init(size_t length)
+{
+    queue_ = xQueueCreate(length, sizeof(BridgeEvent));
+    if (!queue_) {
+        ESP_LOGE(TAG, "Failed to create event queue (%zu events)", length);
+        return ESP_ERR_NO_MEM;
+    }
+    length_ = length;
+    return ESP_OK;
+}
+
+bool BridgeEventQueue::post(BridgeEvent &event, TickType_t wait)
+{
+    event.posted_us = esp_timer_get_time();
+    if (queue_ && xQueueSend(queue_, &event, wait) == pdTRUE) {
+        return true;
+    }
+
+    portENTER_CRITICAL(&mux_);
+    dropped_++;
+    portEXIT_CRITICAL(&mux_);
+    return false;
+}
+
+bool BridgeEventQueue::post_and_wait(BridgeEvent &event, TickType_t timeout)
+{
+    event.waiter = xTaskGetCurrentTaskHandle();
+    event.posted_us = esp_timer_get_time();
+    if (!queue_ || xQueueSend(queue_, &event, timeout) != pdTRUE) {
+        portENTER_CRITICAL(&mux_);
+        dropped_++;
+        portEXIT_CRITICAL(&mux_);
+        return false;
+    }
+    return ulTaskNotifyTake(pdTRUE, timeout) > 0;
+}
+
+bool BridgeEventQueue::wait_device_ready(const char *device_id, TickType_t timeout)
+{
+    // Static: a timed-out SYNC may still be handled after we return
+    static bool s_ready;
+
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        BridgeEvent event = {};
+        event.type = BridgeEventType::SYNC;
+        strlcpy(event.sync.device_id, device_id, sizeof(event.sync.device_id));
+        event.sync.ready = &s_ready;
+        s_ready = false;
+        if (post_and_wait(event, timeout) && s_ready) {
+            return true;
+        }
+        if (xTaskGetTickCount() - start >= timeout) {
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+void BridgeEventQueue::log_stats() const
+{
+    portENTER_CRITICAL(&mux_);
+    uint32_t dropped = dropped_;
+    portEXIT_CRITICAL(&mux_);
+
+    uint32_t avg_x100 = stats_.batches ? (stats_.handled * 100) / stats_.batches : 0;
+    ESP_LOGI(TAG, "Bridge events: %lu handled in %lu batches (avg %lu.%02lu, max %lu, %lu full), "
+                  "%lu dropped, queue %u/%zu",
+             (unsigned long)stats_.handled, (unsigned long)stats_.batches,
+             (unsigned long)(avg_x100 / 100), (unsigned long)(avg_x100 % 100),
+             (unsigned long)stats_.batch_max, (unsigned long)stats_.full_batches,
+             (unsigned long)dropped, (unsigned)uxQueueMessagesWaiting(queue_), length_);
+    if (latency_us_.count() > 0) {
+        ESP_LOGI(TAG, "  queue latency: p50 <%lu us, p90 <%lu us, p99 <%lu us, max %lu us",
+                 (unsigned long)latency_us_.percentile(50), (unsigned long)latency_us_.percentile(90),
+                 (unsigned long)latency_us_.percentile(99), (unsigned long)latency_us_.max());
+    }
+}
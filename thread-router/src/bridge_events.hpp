@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "bridge_dispatch.hpp"
+#include "bridge_nvs.hpp"
+#include "slab_pool.hpp"
+
+extern "C" {
+#include "thread_comms.h"
+}
+
+// Inputs to the bridge task, the only task that touches BridgeState
+enum class BridgeEventType : uint8_t {
+    REPORT,         // Device report (OpenThread task)
+    ON_OFF_WRITE,   // Controller write of a plug's OnOff attribute (CHIP task)
+    PROVISIONED,    // Endpoints created for a new device (provisioning worker)
+    FLUSH,          // Save unsaved sensor values (shutdown handler)
+    ERASE,          // Stop persisting, erase bridge devices (boot button)
+    FACTORY_RESET,  // Stop persisting, erase all of NVS (boot button)
+    SYNC,           // post_and_wait() on it waits for everything queued before; may query a device
+};
+
+struct BridgeEvent {
+    BridgeEventType type;
+    int64_t posted_us;          // Set by post()
+    TaskHandle_t waiter;        // Notified once handled (post_and_wait)
+    SlabHandle device;          // PROVISIONED: the device the endpoints belong to
+    bool has_latency;           // REPORT: sender and bridge had network time
+    int32_t latency_us;         // REPORT: one-way network latency
+    uint32_t latency_error_us;  // REPORT: bound on the latency_us error
+    uint32_t seq;               // REPORT: sender's message sequence number (0 = none)
+    uint32_t epoch;             // REPORT: sender's power-on epoch of seq
+    union {
+        thread_comms_report_t report;
+        struct {
+            uint16_t endpoint_id;
+            bool on;
+        } write;
+        struct {
+            uint8_t kinds;                              // Bit per BridgeEndpointKind attempted
+            uint16_t endpoint_ids[BRIDGE_EP_COUNT];     // 0 = creation failed
+            int64_t queued_us;                          // Device handed to the worker
+        } provisioned;
+        struct {
+            char device_id[BRIDGE_DEVICE_ID_LEN];   // Empty = plain barrier
+            bool *ready;                            // Set: device has live endpoints, none being created
+        } sync;
+    };
+};
+
+// Bounded multi-producer, single-consumer queue of BridgeEvents.
+// Producers never block on bridge state: post() copies the event into the
+// queue or fails when it is full. The bridge task drains it in batches.
+class BridgeEventQueue {
+public:
+    esp_err_t init(size_t length);
+
+    // False (and counted as dropped) if the queue is still full after `wait`
+    bool post(BridgeEvent &event, TickType_t wait = 0);
+
+    // Post and block until the bridge task has handled the event.
+    // Must not be called from the bridge task.
+    bool post_and_wait(BridgeEvent &event, TickType_t timeout);
+
+    // Poll with SYNC until the device has live endpoints and none are being
+    // created. False on timeout. Must not be called from the bridge task.
+    bool wait_device_ready(const char *device_id, TickType_t timeout);
+
+    // Wait up to `wait` for an event, then handle it and whatever else is
+    // already queued, up to max_batch events. Returns the number handled.
+    template <typename Handler>
+    size_t drain(TickType_t wait, size_t max_batch, Handler handle)
+    {
+        BridgeEvent event;
+        if (xQueueReceive(queue_, &event, wait) != pdTRUE) return 0;
+
+        size_t n = 0;
+        do {
+            latency_us_.record(static_cast<uint32_t>(esp_timer_get_time() - event.posted_us));
+            handle(event);
+            if (event.waiter) {
+                xTaskNotifyGive(event.waiter);
+            }
+            n++;
+        } while (n < max_batch && xQueueReceive(queue_, &event, 0) == pdTRUE);
+
+        stats_.batches++;
+        stats_.handled += n;
+        if (n > stats_.batch_max) {
+            stats_.batch_max = n;
+        }
+        if (n == max_batch) {
+            stats_.full_batches++;
+        }
+        return n;
+    }
+
+    void log_stats() const;
+
+private:
+    QueueHandle_t queue_ = nullptr;
+    size_t length_ = 0;
+
+    // Bridge task only, except dropped
+    struct Stats {
+        uint32_t handled = 0;
+        uint32_t batches = 0;
+        uint32_t batch_max = 0;
+        uint32_t full_batches = 0;  // Batches that hit max_batch (more may have been waiting)
+    };
+    Stats stats_;
+    LatencyHistogram latency_us_;   // Post to handling, in us
+
+    mutable portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t dropped_ = 0;          // Queue full (any producer)
+};
@@ -0,0 +1,74 @@
+#include "bridge_index.hpp"
+
+void SlotIndex::insert(uint32_t hash, uint16_t slot)
+{
+    // Keep load (including tombstones) under 70% so probe chains stay short
+    if ((used_ + 1) * 10 > table_.size() * 7) {
+        size_t capacity = table_.empty() ? MIN_CAPACITY : table_.size();
+        while ((size_ + 1) * 10 > capacity * 7) {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+
+    size_t mask = table_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry &e = table_[i];
+        if (e.slot == EMPTY || e.slot == TOMBSTONE) {
+            if (e.slot == EMPTY) used_++;
+            e.hash = hash;
+            e.slot = slot;
+            size_++;
+            return;
+        }
+    }
+}
+
+bool SlotIndex::erase(uint32_t hash, uint16_t slot)
+{
+    if (table_.empty()) return false;
+
+    size_t mask = table_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry &e = table_[i];
+        if (e.slot == EMPTY) return false;
+        if (e.hash == hash && e.slot == slot) {
+            e.slot = TOMBSTONE;
+            size_--;
+            return true;
+        }
+    }
+}
+
+void SlotIndex::reserve(size_t entries)
+{
+    size_t capacity = MIN_CAPACITY;
+    while ((entries + 1) * 10 > capacity * 7) {
+        capacity *= 2;
+    }
+    if (capacity > table_.size()) {
+        rehash(capacity);
+    }
+}
+
+void SlotIndex::clear()
+{
+    table_.clear();
+    size_ = 0;
+    used_ = 0;
+}
+
+void SlotIndex::rehash(size_t capacity)
+{
+    std::vector<Entry> old;
+    old.swap(table_);
+    table_.assign(capacity, Entry{0, EMPTY});
+    size_ = 0;
+    used_ = 0;
+
+    for (const Entry &e : old) {
+        if (e.slot != EMPTY && e.slot != TOMBSTONE) {
+            insert(e.hash, e.slot);
+        }
+    }
+}
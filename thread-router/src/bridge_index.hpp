@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sdkconfig.h"
+
+// FNV-1a over the full device id ("vivid-falcon-a3f2")
+// Also used for the NVS key, so it must never change
+inline uint32_t bridge_hash_device_id(const char *device_id)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *p = device_id; *p; p++) {
+        hash ^= static_cast<uint8_t>(*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Endpoint ids are hashed bijectively, so distinct endpoints never collide
+inline uint32_t bridge_hash_endpoint_id(uint16_t endpoint_id)
+{
+    uint32_t hash = endpoint_id * 0x9E3779B1u;
+    return hash ^ (hash >> 15);
+}
+
+// Open-addressed (linear probing) index from a 32-bit key hash to a device slot.
+// Only hashes are stored - find() confirms candidates with the caller's match
+// function, so two keys with the same hash still resolve to the right slot.
+class SlotIndex {
+public:
+    static constexpr uint16_t NO_SLOT = 0xFFFF;
+
+    template <typename Match>
+    uint16_t find(uint32_t hash, Match match) const
+    {
+        if (table_.empty()) return NO_SLOT;
+
+        size_t mask = table_.size() - 1;
+        lookups_++;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            probes_++;
+            const Entry &e = table_[i];
+            if (e.slot == EMPTY) return NO_SLOT;
+            if (e.slot != TOMBSTONE && e.hash == hash && match(e.slot)) return e.slot;
+        }
+    }
+
+    void insert(uint32_t hash, uint16_t slot);
+    void reserve(size_t entries);   // Pre-size for this many entries
+    bool erase(uint32_t hash, uint16_t slot);
+    void clear();
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return table_.size(); }
+    size_t memory_bytes() const { return table_.capacity() * sizeof(Entry); }
+
+    // Average slots probed per find() since the last reset (x100)
+    uint32_t avg_probes_x100() const { return lookups_ ? (probes_ * 100) / lookups_ : 0; }
+    void reset_stats() const { lookups_ = 0; probes_ = 0; }
+
+private:
+    static constexpr uint16_t EMPTY = 0xFFFF;
+    static constexpr uint16_t TOMBSTONE = 0xFFFE;
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    struct Entry {
+        uint32_t hash;
+        uint16_t slot;
+    };
+
+    std::vector<Entry> table_;
+    size_t size_ = 0;       // Live entries
+    size_t used_ = 0;       // Live entries + tombstones
+    mutable uint32_t lookups_ = 0;
+    mutable uint32_t probes_ = 0;
+
+    void rehash(size_t capacity);
+};
@@ -1,8 +1,13 @@
 #include "bridge_nvs.hpp"
+#include "bridge_index.hpp"
 
+#include <cmath>
 #include <cstring>
+#include <string>
 
 #include "esp_log.h"
+#include "dlog.h"
+#include "event_trace.h"
 #include "nvs_flash.h"
 #include "nvs.h"
 
@@ -12,158 +17,208 @@
 
 static const char *TAG = "tr-nvs";
 
-static const char *NVS_NAMESPACE = "bridge";
-static const char *KEY_GLOBAL = "tr-global";
-static const char *KEY_DEVICE_PREFIX = "tr-dev-";
+// Fixed-point device state
 
-static nvs_handle_t s_nvs_handle = 0;
+// Round to 0.01 units, clamped to the attribute's range
+static int32_t to_centi(float value, int32_t min, int32_t max)
+{
+    long centi = lroundf(value * 100.0f);
+    if (centi < min) return min;
+    if (centi > max) return max;
+    return static_cast<int32_t>(centi);
+}
 
-esp_err_t bridge_nvs_init()
+bool BridgeDeviceState::set_temperature(float celsius)
 {
-    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to open NVS namespace '%s': %s", NVS_NAMESPACE, esp_err_to_name(err));
-        return err;
-    }
-    ESP_LOGI(TAG, "NVS initialized");
-    return ESP_OK;
+    int16_t centi = static_cast<int16_t>(to_centi(celsius, INT16_MIN + 1, INT16_MAX));
+    bool changed = !has_temperature() || temperature_centi != centi;
+    temperature_centi = centi;
+    flags |= HAS_TEMPERATURE;
+    return changed;
 }
 
-uint16_t bridge_nvs_get_next_endpoint_id()
+bool BridgeDeviceState::set_humidity(float percent)
 {
-    uint8_t buf[BridgeNvsGlobal_size];
-    size_t len = sizeof(buf);
+    uint16_t centi = static_cast<uint16_t>(to_centi(percent, 0, 10000));
+    bool changed = !has_humidity() || humidity_centi != centi;
+    humidity_centi = centi;
+    flags |= HAS_HUMIDITY;
+    return changed;
+}
 
-    esp_err_t err = nvs_get_blob(s_nvs_handle, KEY_GLOBAL, buf, &len);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        // First time - start at endpoint 1 (0 is reserved for root node)
-        return 1;
+bool BridgeDeviceState::set_relay_state(bool on)
+{
+    uint8_t bits = HAS_RELAY_STATE | (on ? RELAY_ON : 0);
+    bool changed = (flags & (HAS_RELAY_STATE | RELAY_ON)) != bits;
+    flags = static_cast<uint8_t>((flags & ~RELAY_ON) | bits);
+    return changed;
+}
+
+bool BridgeDeviceState::set_device_id(const char *id)
+{
+    return strlcpy(device_id, id, sizeof(device_id)) < sizeof(device_id);
+}
+
+// Record encoding (shared with the log backend)
+// The on-flash format keeps float values, so records stay compatible
+
+size_t bridge_nvs_encode_device(const BridgeDeviceState &device, uint8_t *buf, size_t buf_size)
+{
+    // Convert to nanopb struct
+    BridgeNvsDevice pb_device = BridgeNvsDevice_init_zero;
+    static_assert(sizeof(pb_device.device_id) == sizeof(device.device_id), "device_id size mismatch");
+    memcpy(pb_device.device_id, device.device_id, sizeof(pb_device.device_id));
+    pb_device.plug_endpoint_id = device.plug_endpoint_id;
+    pb_device.temp_endpoint_id = device.temp_endpoint_id;
+    pb_device.humidity_endpoint_id = device.humidity_endpoint_id;
+
+    if (device.has_temperature()) {
+        pb_device.has_temperature = true;
+        pb_device.temperature = device.temperature();
     }
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read global: %s", esp_err_to_name(err));
-        return 1;
+    if (device.has_humidity()) {
+        pb_device.has_humidity = true;
+        pb_device.humidity = device.humidity();
     }
-
-    BridgeNvsGlobal global = BridgeNvsGlobal_init_zero;
-    pb_istream_t stream = pb_istream_from_buffer(buf, len);
-    if (!pb_decode(&stream, BridgeNvsGlobal_fields, &global)) {
-        ESP_LOGE(TAG, "Failed to decode global");
-        return 1;
+    if (device.has_relay_state()) {
+        pb_device.has_relay_state = true;
+        pb_device.relay_state = device.relay_state();
     }
 
-    return static_cast<uint16_t>(global.next_endpoint_id);
+    // Encode
+    pb_ostream_t stream = pb_ostream_from_buffer(buf, buf_size);
+    if (!pb_encode(&stream, BridgeNvsDevice_fields, &pb_device)) {
+        ESP_LOGE(TAG, "Failed to encode device");
+        return 0;
+    }
+    return stream.bytes_written;
 }
 
-uint16_t bridge_nvs_alloc_endpoint_id()
+std::optional<BridgeDeviceState> bridge_nvs_decode_device(const uint8_t *buf, size_t len)
 {
-    uint16_t id = bridge_nvs_get_next_endpoint_id();
+    BridgeNvsDevice pb_device = BridgeNvsDevice_init_zero;
+    pb_istream_t stream = pb_istream_from_buffer(buf, len);
+    if (!pb_decode(&stream, BridgeNvsDevice_fields, &pb_device)) {
+        return std::nullopt;
+    }
 
-    // Increment and save
-    BridgeNvsGlobal global = BridgeNvsGlobal_init_zero;
-    global.next_endpoint_id = id + 1;
+    // Convert to C++ struct
+    BridgeDeviceState device;
+    device.set_device_id(pb_device.device_id);
+    device.plug_endpoint_id = static_cast<uint16_t>(pb_device.plug_endpoint_id);
+    device.temp_endpoint_id = static_cast<uint16_t>(pb_device.temp_endpoint_id);
+    device.humidity_endpoint_id = static_cast<uint16_t>(pb_device.humidity_endpoint_id);
 
-    uint8_t buf[BridgeNvsGlobal_size];
-    pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
-    if (!pb_encode(&stream, BridgeNvsGlobal_fields, &global)) {
-        ESP_LOGE(TAG, "Failed to encode global");
-        return id;
+    if (pb_device.has_temperature) {
+        device.set_temperature(pb_device.temperature);
     }
-
-    esp_err_t err = nvs_set_blob(s_nvs_handle, KEY_GLOBAL, buf, stream.bytes_written);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to write global: %s", esp_err_to_name(err));
-        return id;
+    if (pb_device.has_humidity) {
+        device.set_humidity(pb_device.humidity);
+    }
+    if (pb_device.has_relay_state) {
+        device.set_relay_state(pb_device.relay_state);
     }
 
-    err = nvs_commit(s_nvs_handle);
+    return device;
+}
+
+#if CONFIG_BRIDGE_STORE_NVS
+
+static const char *NVS_NAMESPACE = "bridge";
+static const char *KEY_DEVICE_PREFIX = "tr-dev-";
+
+// Flash cost estimate per blob write: blob index entry + data entry header, then 32-byte entries
+#define NVS_ENTRY_SIZE      32
+#define NVS_BLOB_OVERHEAD   (2 * NVS_ENTRY_SIZE)
+
+static nvs_handle_t s_nvs_handle = 0;
+static BridgeNvsStats s_stats;
+
+esp_err_t bridge_nvs_init()
+{
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_nvs_handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit: %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "Failed to open NVS namespace '%s': %s", NVS_NAMESPACE, esp_err_to_name(err));
+        return err;
     }
+    ESP_LOGI(TAG, "NVS initialized");
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "Allocated endpoint ID: %u", id);
-    return id;
+// "tr-dev-" + 8 hex digits of the full device_id hash (15 chars, the NVS key limit)
+// The old 4-hex suffix key let two devices with the same MAC low bits overwrite each other
+static void make_device_key(char *key_buf, size_t key_buf_size, const char *device_id)
+{
+    snprintf(key_buf, key_buf_size, "%s%08lx", KEY_DEVICE_PREFIX,
+             (unsigned long)bridge_hash_device_id(device_id));
 }
 
-const char *bridge_nvs_get_hex_suffix(const char *device_id)
+// Legacy key: "tr-dev-" + 4 hex digits
+static bool is_legacy_device_key(const char *key)
 {
-    if (!device_id) return nullptr;
+    return strlen(key) == strlen(KEY_DEVICE_PREFIX) + 4;
+}
 
-    // Find last '-' in "vivid-falcon-a3f2"
-    const char *last_dash = strrchr(device_id, '-');
-    if (!last_dash || strlen(last_dash + 1) != 4) {
-        return nullptr;
-    }
-    return last_dash + 1;
+const BridgeNvsStats &bridge_nvs_get_stats()
+{
+    return s_stats;
 }
 
-static void make_device_key(char *key_buf, size_t key_buf_size, const char *hex_suffix)
+esp_err_t bridge_nvs_commit()
 {
-    snprintf(key_buf, key_buf_size, "%s%s", KEY_DEVICE_PREFIX, hex_suffix);
+    esp_err_t err = nvs_commit(s_nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit: %s", esp_err_to_name(err));
+        return err;
+    }
+    s_stats.commits++;
+    return ESP_OK;
 }
 
-esp_err_t bridge_nvs_save_device(const BridgeDeviceState &device)
+esp_err_t bridge_nvs_save_device(const BridgeDeviceState &device, bool commit)
 {
-    const char *hex = bridge_nvs_get_hex_suffix(device.device_id.c_str());
-    if (!hex) {
-        ESP_LOGE(TAG, "Invalid device_id format: %s", device.device_id.c_str());
+    TraceScope trace(TRACE_ID_BRIDGE_NVS_SAVE);
+
+    if (device.device_id[0] == '\0') {
+        ESP_LOGE(TAG, "Invalid device_id: empty");
         return ESP_ERR_INVALID_ARG;
     }
 
     char key[16];
-    make_device_key(key, sizeof(key), hex);
-
-    // Convert to nanopb struct
-    BridgeNvsDevice pb_device = BridgeNvsDevice_init_zero;
-    strncpy(pb_device.device_id, device.device_id.c_str(), sizeof(pb_device.device_id) - 1);
-    pb_device.plug_endpoint_id = device.plug_endpoint_id;
-    pb_device.temp_endpoint_id = device.temp_endpoint_id;
-    pb_device.humidity_endpoint_id = device.humidity_endpoint_id;
+    make_device_key(key, sizeof(key), device.device_id);
 
-    if (device.temperature.has_value()) {
-        pb_device.has_temperature = true;
-        pb_device.temperature = device.temperature.value();
-    }
-    if (device.humidity.has_value()) {
-        pb_device.has_humidity = true;
-        pb_device.humidity = device.humidity.value();
-    }
-    if (device.relay_state.has_value()) {
-        pb_device.has_relay_state = true;
-        pb_device.relay_state = device.relay_state.value();
-    }
-
-    // Encode
     uint8_t buf[BridgeNvsDevice_size];
-    pb_ostream_t stream = pb_ostream_from_buffer(buf, sizeof(buf));
-    if (!pb_encode(&stream, BridgeNvsDevice_fields, &pb_device)) {
-        ESP_LOGE(TAG, "Failed to encode device");
+    size_t len = bridge_nvs_encode_device(device, buf, sizeof(buf));
+    if (len == 0) {
         return ESP_FAIL;
     }
 
     // Write to NVS
-    esp_err_t err = nvs_set_blob(s_nvs_handle, key, buf, stream.bytes_written);
+    trace.set_arg(len);
+    esp_err_t err = nvs_set_blob(s_nvs_handle, key, buf, len);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write device %s: %s", key, esp_err_to_name(err));
         return err;
     }
-
-    err = nvs_commit(s_nvs_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit: %s", esp_err_to_name(err));
-        return err;
+    s_stats.writes++;
+    s_stats.payload_bytes += len;
+    s_stats.bytes += NVS_BLOB_OVERHEAD + (len + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE * NVS_ENTRY_SIZE;
+
+    if (commit) {
+        err = bridge_nvs_commit();
+        if (err != ESP_OK) {
+            return err;
+        }
     }
 
-    ESP_LOGI(TAG, "Saved device: %s (plug=%u, temp=%u, humidity=%u)",
-             device.device_id.c_str(),
+    DLOGI(TAG, "Saved device: %s (plug=%u, temp=%u, humidity=%u)",
+             device.device_id,
              device.plug_endpoint_id, device.temp_endpoint_id, device.humidity_endpoint_id);
     return ESP_OK;
 }
 
-std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *hex_suffix)
+static std::optional<BridgeDeviceState> load_device_key(const char *key)
 {
-    char key[16];
-    make_device_key(key, sizeof(key), hex_suffix);
-
     uint8_t buf[BridgeNvsDevice_size];
     size_t len = sizeof(buf);
 
@@ -176,38 +231,28 @@ std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *hex_suffix)
         return std::nullopt;
     }
 
-    BridgeNvsDevice pb_device = BridgeNvsDevice_init_zero;
-    pb_istream_t stream = pb_istream_from_buffer(buf, len);
-    if (!pb_decode(&stream, BridgeNvsDevice_fields, &pb_device)) {
+    auto device = bridge_nvs_decode_device(buf, len);
+    if (!device.has_value()) {
         ESP_LOGE(TAG, "Failed to decode device %s", key);
-        return std::nullopt;
     }
+    return device;
+}
 
-    // Convert to C++ struct
-    BridgeDeviceState device;
-    device.device_id = pb_device.device_id;
-    device.plug_endpoint_id = static_cast<uint16_t>(pb_device.plug_endpoint_id);
-    device.temp_endpoint_id = static_cast<uint16_t>(pb_device.temp_endpoint_id);
-    device.humidity_endpoint_id = static_cast<uint16_t>(pb_device.humidity_endpoint_id);
+std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *device_id)
+{
+    char key[16];
+    make_device_key(key, sizeof(key), device_id);
 
-    if (pb_device.has_temperature) {
-        device.temperature = pb_device.temperature;
-    }
-    if (pb_device.has_humidity) {
-        device.humidity = pb_device.humidity;
-    }
-    if (pb_device.has_relay_state) {
-        device.relay_state = pb_device.relay_state;
+    auto device = load_device_key(key);
+    if (device.has_value() && strcmp(device->device_id, device_id) != 0) {
+        // Different id with the same hash
+        return std::nullopt;
     }
-
     return device;
 }
 
-esp_err_t bridge_nvs_delete_device(const char *hex_suffix)
+static esp_err_t delete_device_key(const char *key)
 {
-    char key[16];
-    make_device_key(key, sizeof(key), hex_suffix);
-
     esp_err_t err = nvs_erase_key(s_nvs_handle, key);
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         return ESP_OK;  // Already gone
@@ -223,13 +268,21 @@ esp_err_t bridge_nvs_delete_device(const char *hex_suffix)
         return err;
     }
 
-    ESP_LOGI(TAG, "Deleted device: %s", hex_suffix);
+    ESP_LOGI(TAG, "Deleted device: %s", key);
     return ESP_OK;
 }
 
+esp_err_t bridge_nvs_delete_device(const char *device_id)
+{
+    char key[16];
+    make_device_key(key, sizeof(key), device_id);
+    return delete_device_key(key);
+}
+
 std::vector<BridgeDeviceState> bridge_nvs_load_all_devices()
 {
     std::vector<BridgeDeviceState> devices;
+    std::vector<std::pair<std::string, size_t>> legacy;     // Legacy key, index into devices
 
     nvs_iterator_t it = nullptr;
     esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_NAMESPACE, NVS_TYPE_BLOB, &it);
@@ -240,9 +293,11 @@ std::vector<BridgeDeviceState> bridge_nvs_load_all_devices()
 
         // Check if this is a device key (starts with "tr-dev-")
         if (strncmp(info.key, KEY_DEVICE_PREFIX, strlen(KEY_DEVICE_PREFIX)) == 0) {
-            const char *hex_suffix = info.key + strlen(KEY_DEVICE_PREFIX);
-            auto device = bridge_nvs_load_device(hex_suffix);
+            auto device = load_device_key(info.key);
             if (device.has_value()) {
+                if (is_legacy_device_key(info.key)) {
+                    legacy.emplace_back(info.key, devices.size());
+                }
                 devices.push_back(std::move(device.value()));
             }
         }
@@ -252,6 +307,33 @@ std::vector<BridgeDeviceState> bridge_nvs_load_all_devices()
 
     nvs_release_iterator(it);
 
+    // Re-key legacy records (can't modify NVS while iterating)
+    // If a previous migration saved the new key but didn't delete the old one, drop the old copy
+    std::vector<bool> drop(devices.size(), false);
+    for (const auto &[legacy_key, index] : legacy) {
+        const BridgeDeviceState &device = devices[index];
+        bool migrated = false;
+        for (size_t i = 0; i < devices.size(); i++) {
+            if (i != index && strcmp(devices[i].device_id, device.device_id) == 0) {
+                migrated = true;
+                break;
+            }
+        }
+
+        if (migrated || bridge_nvs_save_device(device) == ESP_OK) {
+            delete_device_key(legacy_key.c_str());
+            ESP_LOGI(TAG, "Migrated legacy key %s for '%s'", legacy_key.c_str(), device.device_id);
+        }
+        drop[index] = migrated;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (!drop[i]) {
+            devices[kept++] = std::move(devices[i]);
+        }
+    }
+    devices.resize(kept);
+
     ESP_LOGI(TAG, "Loaded %zu devices from NVS", devices.size());
     return devices;
 }
@@ -273,3 +355,5 @@ esp_err_t bridge_nvs_erase_all()
     ESP_LOGW(TAG, "Erased all bridge data from NVS");
     return ESP_OK;
 }
+
+#endif // CONFIG_BRIDGE_STORE_NVS
@@ -1,48 +1,97 @@
 #pragma once
 
 #include <optional>
-#include <string>
+#include <type_traits>
 #include <vector>
 #include <cstdint>
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+
+// Device id buffer - the longest generated id ("adjective-noun-xxxx") is 18 chars,
+// 19 bytes with the NUL; rounded up for headroom. Matches the nanopb max_size
+#define BRIDGE_DEVICE_ID_LEN 24
+
+// Capability endpoints of a device; also indexes the interned label table
+enum BridgeEndpointKind : uint8_t {
+    BRIDGE_EP_PLUG,
+    BRIDGE_EP_TEMP,
+    BRIDGE_EP_HUMIDITY,
+    BRIDGE_EP_COUNT,
+};
 
 // Device state for bridge registry
-// Each Thread device can have up to 3 Matter endpoints (one per capability)
+// Each Thread device can have up to 3 Matter endpoints (one per capability).
+// Fixed-size and trivially copyable (no heap): the id is inline and sensor
+// values are fixed point in the units Matter reports them in.
 struct BridgeDeviceState {
-    std::string device_id;          // "vivid-falcon-a3f2"
+    char device_id[BRIDGE_DEVICE_ID_LEN] = {};     // "vivid-falcon-a3f2"
 
     // Endpoint IDs for each capability (0 = not present)
     uint16_t plug_endpoint_id = 0;
     uint16_t temp_endpoint_id = 0;
     uint16_t humidity_endpoint_id = 0;
 
-    // Last known sensor values
-    std::optional<float> temperature;
-    std::optional<float> humidity;
-    std::optional<bool> relay_state;
+    // Last known sensor values (valid when the matching HAS_* bit is set)
+    int16_t temperature_centi = 0;  // 0.01 degC (TemperatureMeasurement MeasuredValue)
+    uint16_t humidity_centi = 0;    // 0.01 %RH (RelativeHumidityMeasurement MeasuredValue)
+    uint8_t flags = 0;
+
+    static constexpr uint8_t HAS_TEMPERATURE = 1 << 0;
+    static constexpr uint8_t HAS_HUMIDITY = 1 << 1;
+    static constexpr uint8_t HAS_RELAY_STATE = 1 << 2;
+    static constexpr uint8_t RELAY_ON = 1 << 3;
+
+    bool has_temperature() const { return flags & HAS_TEMPERATURE; }
+    bool has_humidity() const { return flags & HAS_HUMIDITY; }
+    bool has_relay_state() const { return flags & HAS_RELAY_STATE; }
+
+    float temperature() const { return temperature_centi / 100.0f; }
+    float humidity() const { return humidity_centi / 100.0f; }
+    bool relay_state() const { return flags & RELAY_ON; }
+
+    // Setters return true if the stored value (or its presence) changed
+    bool set_temperature(float celsius);
+    bool set_humidity(float percent);
+    bool set_relay_state(bool on);
+
+    // Copies (and truncates) the id; false if it did not fit
+    bool set_device_id(const char *id);
 };
+static_assert(std::is_trivially_copyable<BridgeDeviceState>::value, "BridgeDeviceState must stay POD-like");
+
+// Storage backend is selected by CONFIG_BRIDGE_STORE_NVS / CONFIG_BRIDGE_STORE_LOG:
+// bridge_nvs.cpp stores one NVS blob per device, bridge_store_log.cpp appends
+// records to a dedicated partition. Both implement this API.
 
 // Initialize NVS namespace for bridge
 esp_err_t bridge_nvs_init();
 
-// Allocate next endpoint ID (increments and persists counter)
-uint16_t bridge_nvs_alloc_endpoint_id();
-
-// Get current endpoint ID counter without incrementing
-uint16_t bridge_nvs_get_next_endpoint_id();
+// Write counters since boot
+struct BridgeNvsStats {
+    uint32_t writes = 0;            // Device records written
+    uint32_t payload_bytes = 0;     // Encoded record bytes
+    uint32_t bytes = 0;             // Flash bytes written (NVS: estimated from entry sizes)
+    uint32_t commits = 0;
+    uint32_t compactions = 0;       // Log backend only
+    uint32_t compaction_bytes = 0;  // Bytes copied by compaction
+};
+const BridgeNvsStats &bridge_nvs_get_stats();
 
 // Device CRUD operations
-esp_err_t bridge_nvs_save_device(const BridgeDeviceState &device);
-std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *hex_suffix);
-esp_err_t bridge_nvs_delete_device(const char *hex_suffix);
+// commit = false batches several saves into one bridge_nvs_commit()
+esp_err_t bridge_nvs_save_device(const BridgeDeviceState &device, bool commit = true);
+esp_err_t bridge_nvs_commit();
+// Keyed by a 32-bit hash of the full device_id (see bridge_hash_device_id)
+std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *device_id);
+esp_err_t bridge_nvs_delete_device(const char *device_id);
 
-// Load all devices from NVS
+// Load all devices from NVS (migrates records stored under legacy 4-hex keys)
 std::vector<BridgeDeviceState> bridge_nvs_load_all_devices();
 
 // Erase all bridge data from NVS (keeps Matter pairing intact)
 esp_err_t bridge_nvs_erase_all();
 
-// Extract hex suffix from device_id: "vivid-falcon-a3f2" -> "a3f2"
-// Returns pointer to suffix within device_id, or nullptr if invalid format
-const char *bridge_nvs_get_hex_suffix(const char *device_id);
+// Protobuf record encoding shared by the backends; encode returns 0 on failure
+size_t bridge_nvs_encode_device(const BridgeDeviceState &device, uint8_t *buf, size_t buf_size);
+std::optional<BridgeDeviceState> bridge_nvs_decode_device(const uint8_t *buf, size_t len);
@@ -0,0 +1,248 @@
+#include "bridge_provision.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dlog.h"
+
+#include <esp_matter_bridge.h>
+#include <esp_matter_cluster.h>
+#include <esp_matter_endpoint.h>
+
+static const char *TAG = "tr-provision";
+
+using namespace esp_matter;
+using namespace esp_matter::cluster;
+
+const EndpointKindInfo BRIDGE_ENDPOINT_KINDS[BRIDGE_EP_COUNT] = {
+    { ESP_MATTER_ON_OFF_PLUG_IN_UNIT_DEVICE_TYPE_ID, "Plug" },
+    { ESP_MATTER_TEMPERATURE_SENSOR_DEVICE_TYPE_ID, "Temp" },
+    { ESP_MATTER_HUMIDITY_SENSOR_DEVICE_TYPE_ID, "Humidity" },
+};
+
+// Initialize cluster callbacks for a dynamically created endpoint
+// This is needed because provider::Startup() only runs once at Matter init,
+// so bridged endpoints created later need their cluster callbacks manually invoked.
+// Caller holds the CHIP stack lock.
+void bridge_init_endpoint_cluster_callbacks(endpoint_t *ep)
+{
+    uint16_t endpoint_id = endpoint::get_id(ep);
+
+    cluster_t *cluster = cluster::get_first(ep);
+
+    while (cluster) {
+        uint8_t flags = cluster::get_flags(cluster);
+
+        cluster::initialization_callback_t init_callback = cluster::get_init_callback(cluster);
+        if (init_callback) {
+            init_callback(endpoint_id);
+        }
+
+        if ((flags & CLUSTER_FLAG_SERVER) && (flags & CLUSTER_FLAG_INIT_FUNCTION)) {
+            cluster::function_cluster_init_t init_function =
+                (cluster::function_cluster_init_t)cluster::get_function(cluster, CLUSTER_FLAG_INIT_FUNCTION);
+            if (init_function) {
+                init_function(endpoint_id);
+            }
+        }
+
+        cluster = cluster::get_next(cluster);
+    }
+}
+
+// Set the node label on a bridged endpoint
+void bridge_set_endpoint_label(endpoint_t *ep, const char *device_id, const char *suffix)
+{
+    cluster_t *bdbi_cluster = cluster::get(ep, chip::app::Clusters::BridgedDeviceBasicInformation::Id);
+    if (bdbi_cluster) {
+        char buf[33];
+        if (suffix) {
+            snprintf(buf, sizeof(buf), "%s %s", device_id, suffix);
+        } else {
+            strncpy(buf, device_id, sizeof(buf) - 1);
+            buf[sizeof(buf) - 1] = '\0';
+        }
+        bridged_device_basic_information::attribute::create_node_label(bdbi_cluster, buf, strlen(buf));
+    }
+}
+
+// Attributes rewritten by every device report. The bridge keeps their last
+// values in its own store, so esp_matter need not write each change to flash.
+static const struct {
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+} REPORT_ATTRIBUTES[] = {
+    { chip::app::Clusters::TemperatureMeasurement::Id,
+      chip::app::Clusters::TemperatureMeasurement::Attributes::MeasuredValue::Id },
+    { chip::app::Clusters::RelativeHumidityMeasurement::Id,
+      chip::app::Clusters::RelativeHumidityMeasurement::Attributes::MeasuredValue::Id },
+    { chip::app::Clusters::OnOff::Id,
+      chip::app::Clusters::OnOff::Attributes::OnOff::Id },
+};
+
+void bridge_defer_report_attribute_persistence(endpoint_t *ep)
+{
+    for (const auto &a : REPORT_ATTRIBUTES) {
+        cluster_t *cluster = cluster::get(ep, a.cluster_id);
+        attribute_t *attr = cluster ? attribute::get(cluster, a.attribute_id) : nullptr;
+        // MeasuredValue is volatile already; only non-volatile ones can be deferred
+        if (!attr || !(attribute::get_flags(attr) & ATTRIBUTE_FLAG_NONVOLATILE)) continue;
+
+        esp_err_t err = attribute::set_deferred_persistence(attr);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to defer persistence of endpoint %u attribute 0x%lx: %s",
+                     endpoint::get_id(ep), (unsigned long)a.attribute_id, esp_err_to_name(err));
+        }
+    }
+}
+
+/*── Provisioning worker ──*/
+
+esp_err_t EndpointProvisioner::start(node_t *node, uint16_t aggregator_endpoint_id, BridgeEventQueue &results)
+{
+    node_ = node;
+    aggregator_endpoint_id_ = aggregator_endpoint_id;
+    results_ = &results;
+
+    // One job per device at most, so a full pool never overflows the queue
+    jobs_ = xQueueCreate(CONFIG_BRIDGE_MAX_DEVICES, sizeof(Job));
+    if (!jobs_) {
+        ESP_LOGE(TAG, "Failed to create provisioning queue");
+        return ESP_ERR_NO_MEM;
+    }
+    // Below the bridge task, so report handling preempts endpoint creation
+    if (xTaskCreate(worker_task, "bridge_prov", 6144, this, 2, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create provisioning task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool EndpointProvisioner::enqueue(SlabHandle device, const char *device_id, uint8_t kinds)
+{
+    if (!jobs_) return false;
+
+    Job job = {};
+    job.device = device;
+    job.kinds = kinds;
+    strlcpy(job.device_id, device_id, sizeof(job.device_id));
+    job.queued_us = esp_timer_get_time();
+    return xQueueSend(jobs_, &job, 0) == pdTRUE;
+}
+
+void EndpointProvisioner::worker_task(void *arg)
+{
+    static_cast<EndpointProvisioner *>(arg)->run();
+}
+
+void EndpointProvisioner::run()
+{
+    uint32_t burst_devices = 0;
+    int64_t burst_start_us = 0;
+
+    while (true) {
+        Job job;
+        xQueueReceive(jobs_, &job, portMAX_DELAY);
+        if (burst_devices == 0) {
+            burst_start_us = job.queued_us;
+        }
+
+        BridgeEvent event = {};
+        event.type = BridgeEventType::PROVISIONED;
+        event.device = job.device;
+        event.provisioned.kinds = job.kinds;
+        event.provisioned.queued_us = job.queued_us;
+
+        uint32_t created = 0;
+        uint32_t failed = 0;
+        int64_t create_us_max = 0;
+        for (int k = 0; k < BRIDGE_EP_COUNT; k++) {
+            if (!(job.kinds & (1u << k))) continue;
+
+            int64_t start = esp_timer_get_time();
+            uint16_t endpoint_id = create_endpoint(job.device_id, static_cast<BridgeEndpointKind>(k));
+            int64_t elapsed = esp_timer_get_time() - start;
+            if (elapsed > create_us_max) {
+                create_us_max = elapsed;
+            }
+            event.provisioned.endpoint_ids[k] = endpoint_id;
+            endpoint_id ? created++ : failed++;
+        }
+
+        // Block rather than drop - the bridge task must learn the endpoint ids
+        results_->post(event, portMAX_DELAY);
+
+        int64_t job_us = esp_timer_get_time() - job.queued_us;
+        portENTER_CRITICAL(&mux_);
+        stats_.devices++;
+        stats_.created += created;
+        stats_.failed += failed;
+        if (create_us_max > stats_.create_us_max) {
+            stats_.create_us_max = create_us_max;
+        }
+        if (job_us > stats_.job_us_max) {
+            stats_.job_us_max = job_us;
+        }
+        portEXIT_CRITICAL(&mux_);
+
+        burst_devices++;
+        if (uxQueueMessagesWaiting(jobs_) == 0) {
+            if (burst_devices > 1) {
+                ESP_LOGI(TAG, "Provisioned %lu devices in %lld ms",
+                         (unsigned long)burst_devices, (long long)(esp_timer_get_time() - burst_start_us) / 1000);
+            }
+            burst_devices = 0;
+        }
+    }
+}
+
+// Create, enable and label one endpoint; returns its id, 0 on failure.
+// Holds the CHIP stack lock throughout, which also serializes it with endpoint
+// resume on the bridge task.
+uint16_t EndpointProvisioner::create_endpoint(const char *device_id, BridgeEndpointKind kind)
+{
+    const EndpointKindInfo &info = BRIDGE_ENDPOINT_KINDS[kind];
+    ChipStackLock chip_lock;
+
+    esp_matter_bridge::device_t *matter_dev = esp_matter_bridge::create_device(
+        node_,
+        aggregator_endpoint_id_,
+        info.device_type_id,
+        nullptr  // priv_data not needed - we set label directly
+    );
+
+    if (!matter_dev) {
+        ESP_LOGE(TAG, "Failed to create endpoint for '%s' (type=0x%lx)",
+                 device_id, (unsigned long)info.device_type_id);
+        return 0;
+    }
+
+    // Enable and initialize the endpoint
+    endpoint::enable(matter_dev->endpoint);
+    bridge_init_endpoint_cluster_callbacks(matter_dev->endpoint);
+
+    // Set the device label so Google Home shows the Thread device name
+    bridge_set_endpoint_label(matter_dev->endpoint, device_id, info.label);
+
+    uint16_t ep_id = matter_dev->persistent_info.device_endpoint_id;
+    ESP_LOGI(TAG, "Created endpoint %u for '%s' (type=0x%lx)",
+             ep_id, device_id, (unsigned long)info.device_type_id);
+    return ep_id;
+}
+
+void EndpointProvisioner::log_stats() const
+{
+    portENTER_CRITICAL(&mux_);
+    Stats s = stats_;
+    portEXIT_CRITICAL(&mux_);
+
+    if (s.devices == 0) return;
+    ESP_LOGI(TAG, "Provisioning: %lu devices, %lu endpoints created, %lu failed, %u queued; "
+                  "endpoint max %lld us, queue-to-done max %lld ms",
+             (unsigned long)s.devices, (unsigned long)s.created, (unsigned long)s.failed,
+             (unsigned)(jobs_ ? uxQueueMessagesWaiting(jobs_) : 0),
+             (long long)s.create_us_max, (long long)s.job_us_max / 1000);
+}
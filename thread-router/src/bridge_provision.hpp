@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include <esp_matter.h>
+#include <platform/CHIPDeviceLayer.h>
+
+#include "bridge_events.hpp"
+#include "bridge_nvs.hpp"
+#include "slab_pool.hpp"
+
+// Holds the CHIP stack lock for a scope (not recursive - don't nest)
+class ChipStackLock {
+public:
+    ChipStackLock() { chip::DeviceLayer::PlatformMgr().LockChipStack(); }
+    ~ChipStackLock() { chip::DeviceLayer::PlatformMgr().UnlockChipStack(); }
+    ChipStackLock(const ChipStackLock&) = delete;
+    ChipStackLock& operator=(const ChipStackLock&) = delete;
+};
+
+// Per-capability endpoint description, indexed by BridgeEndpointKind.
+// Label suffixes are interned here once instead of being passed around per call.
+struct EndpointKindInfo {
+    uint32_t device_type_id;
+    const char *label;
+};
+extern const EndpointKindInfo BRIDGE_ENDPOINT_KINDS[BRIDGE_EP_COUNT];
+
+// Endpoint setup shared by creation and resume (caller holds the CHIP stack lock)
+void bridge_init_endpoint_cluster_callbacks(esp_matter::endpoint_t *ep);
+void bridge_set_endpoint_label(esp_matter::endpoint_t *ep, const char *device_id, const char *suffix = nullptr);
+
+// Defer esp_matter's NVS writes of the attributes device reports update
+// (caller holds the CHIP stack lock)
+void bridge_defer_report_attribute_persistence(esp_matter::endpoint_t *ep);
+
+// Creates the Matter endpoints of newly discovered devices on a background
+// worker. Creating an endpoint takes the CHIP stack lock and writes esp_matter
+// NVS entries, so the bridge task only hands the device over and keeps
+// handling reports; each finished device comes back as a
+// BridgeEventType::PROVISIONED event.
+class EndpointProvisioner {
+public:
+    esp_err_t start(esp_matter::node_t *node, uint16_t aggregator_endpoint_id, BridgeEventQueue &results);
+
+    // Queue creation of the given kinds (BridgeEndpointKind bits). At most one
+    // job per device may be queued, so this only fails if start() did not run.
+    bool enqueue(SlabHandle device, const char *device_id, uint8_t kinds);
+
+    void log_stats() const;
+
+private:
+    struct Job {
+        SlabHandle device;
+        uint8_t kinds;
+        char device_id[BRIDGE_DEVICE_ID_LEN];
+        int64_t queued_us;
+    };
+
+    static void worker_task(void *arg);
+    void run();
+    uint16_t create_endpoint(const char *device_id, BridgeEndpointKind kind);
+
+    esp_matter::node_t *node_ = nullptr;
+    uint16_t aggregator_endpoint_id_ = 0;
+    BridgeEventQueue *results_ = nullptr;
+    QueueHandle_t jobs_ = nullptr;
+
+    struct Stats {
+        uint32_t devices = 0;       // Jobs finished
+        uint32_t created = 0;       // Endpoints
+        uint32_t failed = 0;
+        int64_t create_us_max = 0;  // Longest single endpoint creation
+        int64_t job_us_max = 0;     // Longest enqueue-to-done for a device
+    };
+    mutable portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+    Stats stats_;                   // Written by the worker
+};
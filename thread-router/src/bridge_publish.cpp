@@ -0,0 +1,222 @@
+#include "bridge_publish.hpp"
+
+#include <cstring>
+
+#include "alloc_counter.hpp"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "dlog.h"
+#include "event_trace.h"
+
+#include <esp_matter.h>
+#include <esp_matter_attribute.h>
+
+#include <platform/CHIPDeviceLayer.h>
+
+static const char *TAG = "tr-publish";
+
+using namespace esp_matter;
+
+// Attribute being applied by publish_pending() (CHIP thread only)
+static struct {
+    uint16_t endpoint_id;
+    uint32_t cluster_id;
+    uint32_t attribute_id;
+    bool active;
+} s_applying;
+
+bool AttributePublisher::is_own_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id)
+{
+    return s_applying.active && s_applying.endpoint_id == endpoint_id &&
+           s_applying.cluster_id == cluster_id && s_applying.attribute_id == attribute_id;
+}
+
+bool AttributePublisher::post(uint16_t endpoint_id, BridgeAttr attr, int32_t value)
+{
+    bool schedule = false;
+    bool queued = true;
+
+    portENTER_CRITICAL(&mux_);
+    stats_.posted++;
+
+    uint16_t i = 0;
+    while (i < count_ && !(pending_[i].endpoint_id == endpoint_id && pending_[i].attr == attr)) {
+        i++;
+    }
+    if (i < count_) {
+        pending_[i].value = value;
+        stats_.coalesced++;
+    } else if (count_ < CAPACITY) {
+        pending_[count_++] = Pending{endpoint_id, attr, value};
+    } else {
+        stats_.dropped++;
+        queued = false;
+    }
+
+    if (!scheduled_) {
+        scheduled_ = true;
+        schedule = true;
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (schedule &&
+        chip::DeviceLayer::PlatformMgr().ScheduleWork(publish_work, reinterpret_cast<intptr_t>(this)) != CHIP_NO_ERROR) {
+        // Values stay pending; the next post() retries
+        portENTER_CRITICAL(&mux_);
+        scheduled_ = false;
+        stats_.schedule_failures++;
+        portEXIT_CRITICAL(&mux_);
+    }
+    return queued;
+}
+
+AttributePublisher::Stats AttributePublisher::stats() const
+{
+    portENTER_CRITICAL(&mux_);
+    Stats s = stats_;
+    portEXIT_CRITICAL(&mux_);
+    return s;
+}
+
+/*── esp_matter persistence audit ──*/
+
+struct MatterPersistCounts {
+    uint32_t cluster_id;
+    uint32_t changes;       // Attribute changes seen
+    uint32_t immediate;     // ...of non-volatile attributes, persisted right away
+    uint32_t deferred;      // ...of non-volatile attributes with deferred persistence
+};
+
+// Classified from the attribute flags - esp_matter does not report the NVS
+// writes themselves, so these count persistence requests, not flash writes.
+// Bridged endpoints carry a handful of clusters; further ones share the
+// overflow entry past the tracked ones.
+static constexpr uint8_t PERSIST_AUDIT_CLUSTERS = 8;
+static constexpr uint8_t PERSIST_AUDIT_OTHER = PERSIST_AUDIT_CLUSTERS;
+static portMUX_TYPE s_persist_mux = portMUX_INITIALIZER_UNLOCKED;
+static MatterPersistCounts s_persist_counts[PERSIST_AUDIT_CLUSTERS + 1];
+static uint8_t s_persist_clusters = 0;
+
+void bridge_matter_persist_record(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id)
+{
+    attribute_t *attr = attribute::get(endpoint_id, cluster_id, attribute_id);
+    uint16_t flags = attr ? attribute::get_flags(attr) : 0;
+
+    portENTER_CRITICAL(&s_persist_mux);
+    uint8_t i = 0;
+    while (i < s_persist_clusters && s_persist_counts[i].cluster_id != cluster_id) {
+        i++;
+    }
+    if (i == s_persist_clusters) {
+        if (s_persist_clusters < PERSIST_AUDIT_CLUSTERS) {
+            s_persist_counts[s_persist_clusters++].cluster_id = cluster_id;
+        } else {
+            i = PERSIST_AUDIT_OTHER;
+        }
+    }
+    MatterPersistCounts &c = s_persist_counts[i];
+    c.changes++;
+    if (flags & ATTRIBUTE_FLAG_NONVOLATILE) {
+        if (flags & ATTRIBUTE_FLAG_DEFERRED) {
+            c.deferred++;
+        } else {
+            c.immediate++;
+        }
+    }
+    portEXIT_CRITICAL(&s_persist_mux);
+}
+
+void bridge_matter_persist_log_stats()
+{
+    MatterPersistCounts counts[PERSIST_AUDIT_CLUSTERS + 1];
+    portENTER_CRITICAL(&s_persist_mux);
+    uint8_t n = s_persist_clusters;
+    memcpy(counts, s_persist_counts, sizeof(counts));
+    portEXIT_CRITICAL(&s_persist_mux);
+
+    for (uint8_t i = 0; i < n; i++) {
+        const MatterPersistCounts &c = counts[i];
+        ESP_LOGI(TAG, "  esp_matter cluster 0x%04lx: %lu changes, %lu persisted immediately, %lu deferred",
+                 (unsigned long)c.cluster_id, (unsigned long)c.changes,
+                 (unsigned long)c.immediate, (unsigned long)c.deferred);
+    }
+    const MatterPersistCounts &other = counts[PERSIST_AUDIT_OTHER];
+    if (other.changes > 0) {
+        ESP_LOGI(TAG, "  esp_matter other clusters: %lu changes, %lu persisted immediately, %lu deferred",
+                 (unsigned long)other.changes, (unsigned long)other.immediate, (unsigned long)other.deferred);
+    }
+}
+
+void AttributePublisher::publish_work(intptr_t arg)
+{
+    reinterpret_cast<AttributePublisher *>(arg)->publish_pending();
+}
+
+// Runs on the CHIP thread, which already holds the stack lock
+void AttributePublisher::publish_pending()
+{
+    AllocCounter allocs;    // attribute::update() runs on this thread, not the bridge task
+    int64_t start = esp_timer_get_time();
+    uint32_t published = 0;
+
+    while (true) {
+        Pending p;
+        portENTER_CRITICAL(&mux_);
+        if (count_ == 0) {
+            scheduled_ = false;
+            portEXIT_CRITICAL(&mux_);
+            break;
+        }
+        p = pending_[--count_];
+        portEXIT_CRITICAL(&mux_);
+
+        esp_matter_attr_val_t val;
+        uint32_t cluster_id;
+        uint32_t attribute_id;
+        switch (p.attr) {
+            case BridgeAttr::TEMPERATURE:
+                val = p.value == BRIDGE_ATTR_NULL ? esp_matter_nullable_int16(nullable<int16_t>())
+                                                  : esp_matter_nullable_int16(static_cast<int16_t>(p.value));
+                cluster_id = chip::app::Clusters::TemperatureMeasurement::Id;
+                attribute_id = chip::app::Clusters::TemperatureMeasurement::Attributes::MeasuredValue::Id;
+                break;
+            case BridgeAttr::HUMIDITY:
+                val = p.value == BRIDGE_ATTR_NULL ? esp_matter_nullable_uint16(nullable<uint16_t>())
+                                                  : esp_matter_nullable_uint16(static_cast<uint16_t>(p.value));
+                cluster_id = chip::app::Clusters::RelativeHumidityMeasurement::Id;
+                attribute_id = chip::app::Clusters::RelativeHumidityMeasurement::Attributes::MeasuredValue::Id;
+                break;
+            case BridgeAttr::REACHABLE:
+                val = esp_matter_bool(p.value != 0);
+                cluster_id = chip::app::Clusters::BridgedDeviceBasicInformation::Id;
+                attribute_id = chip::app::Clusters::BridgedDeviceBasicInformation::Attributes::Reachable::Id;
+                break;
+            default:
+                val = esp_matter_bool(p.value != 0);
+                cluster_id = chip::app::Clusters::OnOff::Id;
+                attribute_id = chip::app::Clusters::OnOff::Attributes::OnOff::Id;
+                break;
+        }
+
+        TRACE_BEGIN(TRACE_ID_MATTER_ATTR_UPDATE, p.endpoint_id);
+        s_applying = {p.endpoint_id, cluster_id, attribute_id, true};
+        attribute::update(p.endpoint_id, cluster_id, attribute_id, &val);
+        s_applying.active = false;
+        TRACE_END(TRACE_ID_MATTER_ATTR_UPDATE, p.endpoint_id);
+        DLOGD(TAG, "Updated endpoint %u attribute 0x%lx: %ld",
+              p.endpoint_id, (unsigned long)attribute_id, (long)p.value);
+        published++;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    portENTER_CRITICAL(&mux_);
+    stats_.published += published;
+    stats_.allocs += allocs.count();
+    stats_.batches++;
+    stats_.lock_us_total += elapsed_us;
+    if (elapsed_us > stats_.lock_us_max) {
+        stats_.lock_us_max = elapsed_us;
+    }
+    portEXIT_CRITICAL(&mux_);
+}
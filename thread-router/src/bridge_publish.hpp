@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// Matter attributes the bridge publishes for its devices
+enum class BridgeAttr : uint8_t {
+    TEMPERATURE,    // TemperatureMeasurement MeasuredValue (0.01 degC, nullable)
+    HUMIDITY,       // RelativeHumidityMeasurement MeasuredValue (0.01 %RH, nullable)
+    ON_OFF,         // OnOff OnOff (0/1)
+    REACHABLE,      // BridgedDeviceBasicInformation Reachable (0/1)
+};
+
+// post() value that publishes null to TEMPERATURE / HUMIDITY (value unknown)
+static constexpr int32_t BRIDGE_ATTR_NULL = INT32_MIN;
+
+// Coalescing queue of attribute updates for the CHIP thread.
+// post() records the latest value per endpoint/attribute from any task; a
+// single PlatformMgr().ScheduleWork pass then publishes everything pending
+// while holding the CHIP stack lock once.
+class AttributePublisher {
+public:
+    // Queue a value; replaces a value still pending for the same endpoint/attribute.
+    // Returns false if the queue is full - the caller keeps the value as unpublished
+    bool post(uint16_t endpoint_id, BridgeAttr attr, int32_t value);
+
+    // True if the CHIP thread is applying this exact attribute for us right now
+    // (lets the PRE_UPDATE callback tell our own updates from controller writes).
+    // CHIP thread only.
+    static bool is_own_update(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id);
+
+    struct Stats {
+        uint32_t posted = 0;        // Values handed to post()
+        uint32_t published = 0;     // attribute::update calls made
+        uint32_t coalesced = 0;     // Values replaced before they were published
+        uint32_t dropped = 0;       // Values refused because the queue was full
+        uint32_t batches = 0;       // ScheduleWork passes
+        uint32_t schedule_failures = 0;
+        int64_t lock_us_total = 0;  // CHIP stack lock held for publishing
+        int64_t lock_us_max = 0;
+        uint32_t allocs = 0;        // Heap allocations while publishing (CONFIG_BRIDGE_ALLOC_CHECK)
+    };
+    Stats stats() const;
+
+private:
+    struct Pending {
+        uint16_t endpoint_id;
+        BridgeAttr attr;
+        int32_t value;
+    };
+
+    // Each of a device's 3 endpoints carries its value attribute plus Reachable,
+    // so every distinct endpoint/attribute pair fits and this never overflows
+    static constexpr uint16_t CAPACITY = CONFIG_BRIDGE_MAX_DEVICES * 3 * 2;
+
+    static void publish_work(intptr_t arg);
+    void publish_pending();
+
+    mutable portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+    Pending pending_[CAPACITY];
+    uint16_t count_ = 0;
+    bool scheduled_ = false;
+    Stats stats_;
+};
+
+// Audit of the attribute writes esp_matter persists to its own NVS namespace.
+// Called from the attribute POST_UPDATE callback (CHIP thread), which only runs
+// for changed values; non-volatile attributes are written to NVS right there,
+// or after the persistence delay when deferred.
+void bridge_matter_persist_record(uint16_t endpoint_id, uint32_t cluster_id, uint32_t attribute_id);
+void bridge_matter_persist_log_stats();
@@ -0,0 +1,93 @@
+#include "bridge_schedule.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "esp_log.h"
+#include "dlog.h"
+
+static const char *TAG = "tr-schedule";
+
+static_assert(CONFIG_BRIDGE_SLOT_PERIOD_MS / CONFIG_BRIDGE_SLOT_COUNT > 0, "Slots must be at least 1 ms wide");
+
+uint16_t SlotScheduler::least_loaded_slot() const
+{
+    uint16_t best = 0;
+    for (uint16_t i = 1; i < CONFIG_BRIDGE_SLOT_COUNT; i++) {
+        if (load_[i] < load_[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int32_t SlotScheduler::offset_ms(uint16_t slot, int64_t now_ms) const
+{
+    int32_t phase = static_cast<int32_t>((now_ms - static_cast<int64_t>(slot) * SLOT_MS) % PERIOD_MS);
+    if (phase < 0) {
+        phase += PERIOD_MS;
+    }
+    return phase > static_cast<int32_t>(PERIOD_MS / 2) ? phase - static_cast<int32_t>(PERIOD_MS) : phase;
+}
+
+bool SlotScheduler::on_wake(SlotState &s, const char *device_id, int64_t now_ms, thread_comms_schedule_t *out)
+{
+    stats_.wakes++;
+
+    bool send;
+    if (s.slot == SlotState::NONE) {
+        s.slot = least_loaded_slot();
+        load_[s.slot]++;
+        stats_.devices++;
+        DLOGI(TAG, "'%s' assigned report slot %u", device_id, s.slot);
+        send = true;
+    } else {
+        int32_t offset = offset_ms(s.slot, now_ms);
+        offset_ms_.record(static_cast<uint32_t>(abs(offset)));
+        bool on_slot = abs(offset) <= CONFIG_BRIDGE_SLOT_TOLERANCE_MS;
+        if (on_slot) {
+            stats_.on_slot++;
+        } else {
+            DLOGD(TAG, "'%s' woke %ld ms off its slot", device_id, (long)offset);
+        }
+        s.wakes_since_sent++;
+        send = !on_slot || (CONFIG_BRIDGE_SLOT_RESYNC > 0 && s.wakes_since_sent >= CONFIG_BRIDGE_SLOT_RESYNC);
+    }
+    if (!send) return false;
+
+    // The first slot start at least half a period away: the device is awake
+    // now and still has its listen window and a deep sleep ahead of it
+    int64_t base = static_cast<int64_t>(s.slot) * SLOT_MS;
+    int64_t from = now_ms + PERIOD_MS / 2 - base;
+    int64_t cycles = from <= 0 ? 0 : (from + PERIOD_MS - 1) / PERIOD_MS;
+    int64_t next_ms = base + cycles * PERIOD_MS;
+
+    memset(out, 0, sizeof(*out));
+    strlcpy(out->device_id, device_id, sizeof(out->device_id));
+    out->period_ms = PERIOD_MS;
+    out->next_slot_ms = static_cast<uint32_t>(next_ms - now_ms);
+    out->slot = s.slot;
+
+    s.wakes_since_sent = 0;
+    stats_.sent++;
+    return true;
+}
+
+void SlotScheduler::release(SlotState &s)
+{
+    if (s.slot == SlotState::NONE) return;
+    load_[s.slot]--;
+    stats_.devices--;
+    s = SlotState{};
+}
+
+void SlotScheduler::log_stats() const
+{
+    ESP_LOGI(TAG, "Report slots: %lu devices in %u slots of %lu ms, %lu of %lu wakes on slot, %lu assignments sent",
+             (unsigned long)stats_.devices, (unsigned)CONFIG_BRIDGE_SLOT_COUNT, (unsigned long)SLOT_MS,
+             (unsigned long)stats_.on_slot, (unsigned long)stats_.wakes, (unsigned long)stats_.sent);
+    if (offset_ms_.count() == 0) return;
+    ESP_LOGI(TAG, "  wake offset from slot: p50 <%lu ms, p90 <%lu ms, max %lu ms",
+             (unsigned long)offset_ms_.percentile(50), (unsigned long)offset_ms_.percentile(90),
+             (unsigned long)offset_ms_.max());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+#include "bridge_dispatch.hpp"
+
+extern "C" {
+#include "thread_comms.h"
+}
+
+// Report slot of one sleepy device, kept in BridgeDevice
+struct SlotState {
+    static constexpr uint16_t NONE = 0xFFFF;
+    uint16_t slot = NONE;
+    uint16_t wakes_since_sent = 0;
+};
+
+// Spreads sleepy devices' reports over CONFIG_BRIDGE_SLOT_PERIOD_MS, split into
+// CONFIG_BRIDGE_SLOT_COUNT slots on the router's clock. A device gets the least
+// loaded slot at its first wake. The assignment (period and time to the next
+// slot start) is sent again when a wake lands more than
+// CONFIG_BRIDGE_SLOT_TOLERANCE_MS off the slot, and every
+// CONFIG_BRIDGE_SLOT_RESYNC wakes. Devices align their deep sleep to it and
+// correct their own clock drift from successive assignments.
+class SlotScheduler {
+public:
+    // First report of a sleepy device's wake window (uptime in ms). Returns
+    // true, with `out` filled in, when an assignment should be sent.
+    bool on_wake(SlotState &s, const char *device_id, int64_t now_ms, thread_comms_schedule_t *out);
+
+    // Give up a device's slot (device gone); it gets the least loaded one at its next wake
+    void release(SlotState &s);
+
+    void log_stats() const;
+
+private:
+    static constexpr uint32_t PERIOD_MS = CONFIG_BRIDGE_SLOT_PERIOD_MS;
+    static constexpr uint32_t SLOT_MS = CONFIG_BRIDGE_SLOT_PERIOD_MS / CONFIG_BRIDGE_SLOT_COUNT;
+
+    uint16_t least_loaded_slot() const;
+    // Signed distance from the nearest start of the slot, in (-PERIOD_MS/2, PERIOD_MS/2]
+    int32_t offset_ms(uint16_t slot, int64_t now_ms) const;
+
+    uint16_t load_[CONFIG_BRIDGE_SLOT_COUNT] = {};  // Devices per slot
+
+    struct Stats {
+        uint32_t devices = 0;       // Devices holding a slot
+        uint32_t wakes = 0;
+        uint32_t on_slot = 0;       // Wakes within tolerance of their slot
+        uint32_t sent = 0;          // Assignments sent (first, realign, resync)
+    };
+    Stats stats_;
+    LatencyHistogram offset_ms_;    // |wake - slot start| of assigned devices
+};
@@ -1,7 +1,14 @@
 #include "bridge_state.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
+#include "alloc_counter.hpp"
+
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "dlog.h"
+#include "event_trace.h"
 
 #include <esp_matter_cluster.h>
 #include <esp_matter_attribute.h>
@@ -14,55 +21,30 @@ static const char *TAG = "tr-bridge";
 using namespace esp_matter;
 using namespace esp_matter::cluster;
 
-// Initialize cluster callbacks for a dynamically created endpoint
-// This is needed because provider::Startup() only runs once at Matter init,
-// so bridged endpoints created later need their cluster callbacks manually invoked
-static void init_endpoint_cluster_callbacks(endpoint_t *ep)
+static uint16_t &endpoint_id_ref(BridgeDeviceState &p, BridgeEndpointKind kind)
 {
-    uint16_t endpoint_id = endpoint::get_id(ep);
-
-    chip::DeviceLayer::PlatformMgr().LockChipStack();
-
-    cluster_t *cluster = cluster::get_first(ep);
-
-    while (cluster) {
-        uint8_t flags = cluster::get_flags(cluster);
-
-        cluster::initialization_callback_t init_callback = cluster::get_init_callback(cluster);
-        if (init_callback) {
-            init_callback(endpoint_id);
-        }
-
-        if ((flags & CLUSTER_FLAG_SERVER) && (flags & CLUSTER_FLAG_INIT_FUNCTION)) {
-            cluster::function_cluster_init_t init_function =
-                (cluster::function_cluster_init_t)cluster::get_function(cluster, CLUSTER_FLAG_INIT_FUNCTION);
-            if (init_function) {
-                init_function(endpoint_id);
-            }
-        }
-
-        cluster = cluster::get_next(cluster);
+    switch (kind) {
+        case BRIDGE_EP_PLUG: return p.plug_endpoint_id;
+        case BRIDGE_EP_TEMP: return p.temp_endpoint_id;
+        default: return p.humidity_endpoint_id;
     }
-
-    chip::DeviceLayer::PlatformMgr().UnlockChipStack();
 }
 
-// Set the node label on a bridged endpoint
-static void set_endpoint_label(endpoint_t *ep, const char *device_id, const char *suffix = nullptr)
+uint16_t BridgeDevice::endpoint_id(BridgeEndpointKind kind) const
 {
-    cluster_t *bdbi_cluster = cluster::get(ep, chip::app::Clusters::BridgedDeviceBasicInformation::Id);
-    if (bdbi_cluster) {
-        char buf[33];
-        if (suffix) {
-            snprintf(buf, sizeof(buf), "%s %s", device_id, suffix);
-        } else {
-            strncpy(buf, device_id, sizeof(buf) - 1);
-            buf[sizeof(buf) - 1] = '\0';
-        }
-        bridged_device_basic_information::attribute::create_node_label(bdbi_cluster, buf, strlen(buf));
+    switch (kind) {
+        case BRIDGE_EP_PLUG: return persisted.plug_endpoint_id;
+        case BRIDGE_EP_TEMP: return persisted.temp_endpoint_id;
+        default: return persisted.humidity_endpoint_id;
     }
 }
 
+// Timer wheel ticks covering a delay, rounded up (<= 0 fires on the next tick)
+static uint32_t ms_to_ticks(int32_t delay_ms)
+{
+    return delay_ms > 0 ? (delay_ms + CONFIG_BRIDGE_TIMER_TICK_MS - 1) / CONFIG_BRIDGE_TIMER_TICK_MS : 0;
+}
+
 esp_err_t BridgeState::device_type_callback(endpoint_t *ep,
                                             uint32_t device_type_id,
                                             void *priv_data)
@@ -77,6 +59,7 @@ esp_err_t BridgeState::device_type_callback(endpoint_t *ep,
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to add temperature_sensor: %s", esp_err_to_name(err));
             }
+            bridge_defer_report_attribute_persistence(ep);
             break;
         }
 
@@ -86,6 +69,7 @@ esp_err_t BridgeState::device_type_callback(endpoint_t *ep,
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to add humidity_sensor: %s", esp_err_to_name(err));
             }
+            bridge_defer_report_attribute_persistence(ep);
             break;
         }
 
@@ -95,6 +79,7 @@ esp_err_t BridgeState::device_type_callback(endpoint_t *ep,
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to add on_off_plug_in_unit: %s", esp_err_to_name(err));
             }
+            bridge_defer_report_attribute_persistence(ep);
             break;
         }
 
@@ -106,7 +91,7 @@ esp_err_t BridgeState::device_type_callback(endpoint_t *ep,
     return ESP_OK;
 }
 
-esp_err_t BridgeState::init(node_t *node, uint16_t aggregator_endpoint_id)
+esp_err_t BridgeState::init(node_t *node, uint16_t aggregator_endpoint_id, BridgeEventQueue &events)
 {
     node_ = node;
     aggregator_endpoint_id_ = aggregator_endpoint_id;
@@ -117,55 +102,74 @@ esp_err_t BridgeState::init(node_t *node, uint16_t aggregator_endpoint_id)
         return err;
     }
 
-    // Load all devices from our NVS
-    auto persisted = bridge_nvs_load_all_devices();
-    ESP_LOGI(TAG, "Resuming %zu devices from NVS", persisted.size());
+    err = provisioner_.start(node, aggregator_endpoint_id, events);
+    if (err != ESP_OK) {
+        return err;
+    }
 
-    for (auto &p : persisted) {
-        BridgeDevice dev;
-        dev.persisted = std::move(p);
+    // Size the indexes for a full pool so lookups never rehash after boot
+    by_device_id_.reserve(devices_.capacity());
+    by_endpoint_.reserve(devices_.capacity() * 3);
+    log_memory_footprint();
 
-        resume_endpoints_for_device(dev);
+    // Load all devices from our NVS. Their Matter endpoints are resumed later by
+    // resume_batch() (or on their first report), so Thread ingestion can start now.
+    auto persisted = bridge_nvs_load_all_devices();
+    ESP_LOGI(TAG, "Loaded %zu devices from NVS", persisted.size());
 
-        devices_.push_back(std::move(dev));
+    for (auto &p : persisted) {
+        BridgeDevice *dev = alloc_device(p.device_id);
+        if (!dev) {
+            ESP_LOGE(TAG, "Device pool full (%u) - not resuming '%s'", devices_.capacity(), p.device_id);
+            continue;
+        }
+        dev->persisted = p;
+        dev->resume_pending = true;
+        index_endpoints(*dev);
+        arm_liveness(*dev);     // No interval learned yet - CONFIG_BRIDGE_LIVENESS_DEFAULT_S
+        resume_stats_.pending++;
     }
+    resume_stats_.start_us = esp_timer_get_time();
 
     return ESP_OK;
 }
 
-esp_matter_bridge::device_t *BridgeState::create_single_endpoint(BridgeDevice &dev, uint32_t device_type_id, const char *label_suffix)
+size_t BridgeState::resume_batch(size_t max_devices)
 {
-    esp_matter_bridge::device_t *matter_dev = esp_matter_bridge::create_device(
-        node_,
-        aggregator_endpoint_id_,
-        device_type_id,
-        nullptr  // priv_data not needed - we set label directly
-    );
-
-    if (!matter_dev) {
-        ESP_LOGE(TAG, "Failed to create endpoint for '%s' (type=0x%lx)",
-                 dev.persisted.device_id.c_str(), (unsigned long)device_type_id);
-        return nullptr;
+    if (resume_stats_.pending == 0) return 0;
+
+    int64_t start = esp_timer_get_time();
+    size_t resumed = 0;
+    {
+        ChipStackLock chip_lock;
+        for (auto &dev : devices_) {
+            if (resumed == max_devices) break;
+            if (!dev.resume_pending) continue;
+            resume_endpoints_for_device(dev);
+            resumed++;
+        }
     }
 
-    // Enable and initialize the endpoint
-    endpoint::enable(matter_dev->endpoint);
-    init_endpoint_cluster_callbacks(matter_dev->endpoint);
-
-    // Set the device label so Google Home shows the Thread device name
-    set_endpoint_label(matter_dev->endpoint, dev.persisted.device_id.c_str(), label_suffix);
-
-    uint16_t ep_id = matter_dev->persistent_info.device_endpoint_id;
-    ESP_LOGI(TAG, "Created endpoint %u for '%s' (type=0x%lx)",
-             ep_id, dev.persisted.device_id.c_str(), (unsigned long)device_type_id);
+    int64_t now = esp_timer_get_time();
+    resume_stats_.batches++;
+    if (now - start > resume_stats_.lock_us_max) {
+        resume_stats_.lock_us_max = now - start;
+    }
 
-    return matter_dev;
+    if (resume_stats_.pending == 0) {
+        ESP_LOGI(TAG, "Resumed %lu devices in %lld ms (%lu batches, %lu on first report, CHIP lock max %lld us)",
+                 (unsigned long)resume_stats_.resumed, (long long)(now - resume_stats_.start_us) / 1000,
+                 (unsigned long)resume_stats_.batches, (unsigned long)resume_stats_.on_demand,
+                 (long long)resume_stats_.lock_us_max);
+    }
+    return resume_stats_.pending;
 }
 
-esp_matter_bridge::device_t *BridgeState::resume_single_endpoint(BridgeDevice &dev, uint16_t endpoint_id, const char *label_suffix)
+uint16_t BridgeState::resume_single_endpoint(BridgeDevice &dev, BridgeEndpointKind kind)
 {
+    uint16_t endpoint_id = dev.endpoint_id(kind);
     if (endpoint_id == 0) {
-        return nullptr;
+        return 0;
     }
 
     esp_matter_bridge::device_t *matter_dev = esp_matter_bridge::resume_device(
@@ -176,158 +180,292 @@ esp_matter_bridge::device_t *BridgeState::resume_single_endpoint(BridgeDevice &d
 
     if (!matter_dev) {
         ESP_LOGE(TAG, "Failed to resume endpoint %u for '%s'",
-                 endpoint_id, dev.persisted.device_id.c_str());
-        return nullptr;
+                 endpoint_id, dev.persisted.device_id);
+        return 0;
     }
 
     endpoint::enable(matter_dev->endpoint);
-    init_endpoint_cluster_callbacks(matter_dev->endpoint);
+    bridge_init_endpoint_cluster_callbacks(matter_dev->endpoint);
 
     // Re-set the label in case it wasn't persisted
-    set_endpoint_label(matter_dev->endpoint, dev.persisted.device_id.c_str(), label_suffix);
+    bridge_set_endpoint_label(matter_dev->endpoint, dev.persisted.device_id, BRIDGE_ENDPOINT_KINDS[kind].label);
 
-    ESP_LOGI(TAG, "Resumed endpoint %u for '%s'", endpoint_id, dev.persisted.device_id.c_str());
-    return matter_dev;
+    DLOGI(TAG, "Resumed endpoint %u for '%s'", endpoint_id, dev.persisted.device_id);
+    return endpoint_id;
 }
 
 void BridgeState::resume_endpoints_for_device(BridgeDevice &dev)
 {
-    ESP_LOGI(TAG, "Resuming device '%s' (plug=%u, temp=%u, humidity=%u)",
-             dev.persisted.device_id.c_str(),
-             dev.persisted.plug_endpoint_id,
-             dev.persisted.temp_endpoint_id,
-             dev.persisted.humidity_endpoint_id);
-
-    dev.plug_device = resume_single_endpoint(dev, dev.persisted.plug_endpoint_id, "Plug");
-    dev.temp_device = resume_single_endpoint(dev, dev.persisted.temp_endpoint_id, "Temp");
-    dev.humidity_device = resume_single_endpoint(dev, dev.persisted.humidity_endpoint_id, "Humidity");
+    dev.resume_pending = false;
+    resume_stats_.pending--;
+    resume_stats_.resumed++;
+
+    DLOGI(TAG, "Resuming device '%s' (plug=%u, temp=%u, humidity=%u)",
+          dev.persisted.device_id,
+          dev.persisted.plug_endpoint_id,
+          dev.persisted.temp_endpoint_id,
+          dev.persisted.humidity_endpoint_id);
+
+    for (int k = 0; k < BRIDGE_EP_COUNT; k++) {
+        BridgeEndpointKind kind = static_cast<BridgeEndpointKind>(k);
+        if (resume_single_endpoint(dev, kind)) {
+            dev.endpoints_live |= 1u << kind;
+        }
+    }
 }
 
-void BridgeState::create_endpoints_for_device(BridgeDevice &dev, const thread_comms_report_t *report)
+void BridgeState::request_endpoints(BridgeDevice &dev, const thread_comms_report_t *report)
 {
-    ESP_LOGI(TAG, "Creating endpoints for device '%s'", dev.persisted.device_id.c_str());
-
-    // Create plug endpoint if device has relay
-    if (report->has_relay_state && dev.persisted.plug_endpoint_id == 0) {
-        dev.plug_device = create_single_endpoint(dev, ESP_MATTER_ON_OFF_PLUG_IN_UNIT_DEVICE_TYPE_ID, "Plug");
-        if (dev.plug_device) {
-            dev.persisted.plug_endpoint_id = dev.plug_device->persistent_info.device_endpoint_id;
+    // One endpoint per capability the device reports (plug = relay)
+    const bool reported[BRIDGE_EP_COUNT] = {
+        report->has_relay_state,
+        report->has_temperature,
+        report->has_humidity,
+    };
+
+    uint8_t missing = 0;
+    for (int k = 0; k < BRIDGE_EP_COUNT; k++) {
+        if (reported[k] && dev.endpoint_id(static_cast<BridgeEndpointKind>(k)) == 0) {
+            missing |= 1u << k;
         }
     }
+    // Capabilities that show up while a job is running are picked up by a later report
+    if (missing == 0 || dev.provisioning) return;
 
-    // Create temperature sensor endpoint if device has temperature
-    if (report->has_temperature && dev.persisted.temp_endpoint_id == 0) {
-        dev.temp_device = create_single_endpoint(dev, ESP_MATTER_TEMPERATURE_SENSOR_DEVICE_TYPE_ID, "Temp");
-        if (dev.temp_device) {
-            dev.persisted.temp_endpoint_id = dev.temp_device->persistent_info.device_endpoint_id;
-        }
+    if (!provisioner_.enqueue(handle_of(dev), dev.persisted.device_id, missing)) {
+        ESP_LOGE(TAG, "Failed to queue endpoints for '%s'", dev.persisted.device_id);
+        return;
     }
+    dev.provisioning = true;
+    ESP_LOGI(TAG, "Queued endpoints for device '%s' (kinds 0x%x)", dev.persisted.device_id, missing);
+}
 
-    // Create humidity sensor endpoint if device has humidity
-    if (report->has_humidity && dev.persisted.humidity_endpoint_id == 0) {
-        dev.humidity_device = create_single_endpoint(dev, ESP_MATTER_HUMIDITY_SENSOR_DEVICE_TYPE_ID, "Humidity");
-        if (dev.humidity_device) {
-            dev.persisted.humidity_endpoint_id = dev.humidity_device->persistent_info.device_endpoint_id;
+void BridgeState::on_provisioned(const BridgeEvent &event)
+{
+    BridgeDevice *dev = get(event.device);
+    if (!dev) return;
+    dev->provisioning = false;
+
+    bool created = false;
+    for (int k = 0; k < BRIDGE_EP_COUNT; k++) {
+        BridgeEndpointKind kind = static_cast<BridgeEndpointKind>(k);
+        uint16_t endpoint_id = event.provisioned.endpoint_ids[k];
+        if (!(event.provisioned.kinds & (1u << k)) || endpoint_id == 0) continue;
+
+        endpoint_id_ref(dev->persisted, kind) = endpoint_id;
+        dev->endpoints_live |= 1u << kind;
+        created = true;
+    }
+    if (!created) return;   // Retried on the next report
+    index_endpoints(*dev);
+
+    // New endpoint ids are persisted right away
+    if (!dev->nvs_key_collision) {
+        esp_err_t err = bridge_nvs_save_device(dev->persisted);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save device '%s' to NVS: %s",
+                     dev->persisted.device_id, esp_err_to_name(err));
+        } else {
+            persist_stats_.immediate++;
         }
+        dev->dirty = (err != ESP_OK);
     }
+
+    // Values reported so far were held back until the endpoints existed
+    update_matter_attributes(*dev, dev->cmd_schedule.state != ReconcileState::PENDING);
+    update_reachable(*dev);
+    provision_latency_ms_.record(static_cast<uint32_t>((esp_timer_get_time() - event.provisioned.queued_us) / 1000));
 }
 
-void BridgeState::on_report(const thread_comms_report_t *report)
+void BridgeState::on_report(const BridgeEvent &event)
 {
+    const thread_comms_report_t *report = &event.report;
+    TraceScope trace(TRACE_ID_BRIDGE_REPORT);
+
+    // Ids are stored inline; a longer one would be truncated and never match again
+    if (strnlen(report->device_id, sizeof(report->device_id)) >= BRIDGE_DEVICE_ID_LEN) {
+        ESP_LOGW(TAG, "Device id '%.*s' too long - ignoring report",
+                 (int)sizeof(report->device_id), report->device_id);
+        return;
+    }
+
     BridgeDevice *dev = find_by_device_id(report->device_id);
 
+    // Loaded at boot but not resumed yet - bring its endpoints up ahead of the batch
+    if (dev && dev->resume_pending) {
+        ChipStackLock chip_lock;
+        resume_endpoints_for_device(*dev);
+        resume_stats_.on_demand++;
+    }
+
     if (!dev) {
         // New device
-        BridgeDevice new_dev;
-        new_dev.persisted.device_id = report->device_id;
-
-        // Populate sensor values before creating endpoints
-        if (report->has_temperature) {
-            new_dev.persisted.temperature = report->temperature;
-        }
-        if (report->has_humidity) {
-            new_dev.persisted.humidity = report->humidity;
-        }
-        if (report->has_relay_state) {
-            new_dev.persisted.relay_state = report->relay_state;
+        // Two ids hashing to the same NVS key would overwrite each other's record
+        uint32_t hash = bridge_hash_device_id(report->device_id);
+        uint16_t other = by_device_id_.find(hash, [](uint16_t) { return true; });
+
+        dev = alloc_device(report->device_id);
+        if (!dev) {
+            ESP_LOGE(TAG, "Device pool full (%u) - ignoring '%s'", devices_.capacity(), report->device_id);
+            return;
         }
 
-        // Create Matter endpoints for each capability
-        create_endpoints_for_device(new_dev, report);
+        if (other != SlotIndex::NO_SLOT) {
+            ESP_LOGE(TAG, "Device '%s' collides with '%s' on NVS key - not persisting it",
+                     report->device_id, devices_.at(other).persisted.device_id);
+            dev->nvs_key_collision = true;
+        }
+        TRACE_COUNTER(TRACE_ID_BRIDGE_DEVICES, devices_.size());
+    }
 
-        devices_.push_back(std::move(new_dev));
-        dev = &devices_.back();
+    delivery_.on_message(dev->delivery, event.epoch, event.seq);
+    if (event.has_latency) {
+        record_latency(*dev, event.latency_us, event.latency_error_us);
     } else {
-        // Existing device - create any missing endpoints (for migration or new capabilities)
-        create_endpoints_for_device(*dev, report);
+        latency_stats_.unstamped++;
     }
 
-    // Update sensor values
+    // Missing endpoints (new device, migration or new capabilities) are created
+    // by the provisioning worker; on_provisioned() publishes the values
+    request_endpoints(*dev, report);
+
+    // Update sensor values (compared at the stored 0.01 resolution)
+    bool changed = false;
     if (report->has_temperature) {
-        dev->persisted.temperature = report->temperature;
+        changed |= dev->persisted.set_temperature(report->temperature);
     }
     if (report->has_humidity) {
-        dev->persisted.humidity = report->humidity;
+        changed |= dev->persisted.set_humidity(report->humidity);
     }
     if (report->has_relay_state) {
-        dev->persisted.relay_state = report->relay_state;
+        changed |= dev->persisted.set_relay_state(report->relay_state);
     }
 
-    dev->last_seen_ms = esp_timer_get_time() / 1000;
+    uint32_t now_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    // An interval spanning an outage says nothing about the report period. Skip
+    // it, and clamp gaps from lost reports to twice the estimate so they nudge
+    // it up (a real period change is still learned) instead of doubling it
+    if (dev->last_seen_ms != 0 && !dev->stale) {
+        uint32_t interval = now_ms - dev->last_seen_ms;
+        if (dev->report_period_ms && interval > 2 * dev->report_period_ms) {
+            interval = 2 * dev->report_period_ms;
+        }
+        dev->report_period_ms = dev->report_period_ms
+            ? dev->report_period_ms + static_cast<int32_t>(interval - dev->report_period_ms) / 4
+            : interval;
+    }
+    dev->last_seen_ms = now_ms;
+    if (dispatcher_.observe_report(dev->cmd_schedule, report, now_ms)) {
+        schedule_report_slot(*dev);
+    }
 
-    // Persist to NVS
-    esp_err_t err = bridge_nvs_save_device(dev->persisted);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save device '%s' to NVS: %s",
-                 dev->persisted.device_id.c_str(), esp_err_to_name(err));
+    // Persist to NVS: sensor values on the next flush (endpoint ids are saved by on_provisioned)
+    if (dev->nvs_key_collision) {
+        // Not persisted
+    } else if (CONFIG_BRIDGE_NVS_FLUSH_INTERVAL_S == 0) {
+        esp_err_t err = bridge_nvs_save_device(dev->persisted);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save device '%s' to NVS: %s",
+                     dev->persisted.device_id, esp_err_to_name(err));
+        } else {
+            persist_stats_.immediate++;
+        }
+        dev->dirty = (err != ESP_OK);
+    } else if (changed) {
+        if (dev->dirty) {
+            persist_stats_.coalesced++;
+        }
+        dev->dirty = true;
     }
 
-    // Send any pending command
-    // So it creates a discrepancy in what matter's world view is vs what the thread device state will be
-    if (dev->cmd_pending) {
-        send_pending_command(*dev);
-        dev->cmd_pending = false;
+    // Reconcile the reported relay state with the desired one. A mismatch while
+    // PENDING re-arms the timer to resend now - the device just proved it is listening.
+    if (report->has_relay_state) {
+        dispatcher_.on_report(dev->cmd_schedule, report->relay_state, now_ms);
+        arm_reconcile(*dev, now_ms);
     }
-    // We dont want to update matter attributes if there is a command pending,
-    // This is because the command will likely change the state. 
-    else {
-        // Update Matter attributes
-        updating_from_thread = true;
-        update_matter_attributes(*dev);
-        updating_from_thread = false;
 
+    // Alive again - sensor values were nulled, so they are republished below
+    if (dev->stale) {
+        dev->stale = false;
+        liveness_stats_.stale--;
+        liveness_stats_.recovered++;
+        ESP_LOGI(TAG, "'%s' reporting again", dev->persisted.device_id);
+    }
+    arm_liveness(*dev);
+
+    // Update Matter attributes (published on the CHIP thread)
+    // While a command is pending Matter already shows the desired relay state,
+    // so the reported (old) one is held back
+    update_matter_attributes(*dev, dev->cmd_schedule.state != ReconcileState::PENDING);
+    update_reachable(*dev);
+
+    if (!first_report_logged_) {
+        first_report_logged_ = true;
+        ESP_LOGI(TAG, "First report processed %lld ms after boot (%lu of %lu devices still resuming)",
+                 (long long)(esp_timer_get_time() / 1000), (unsigned long)resume_stats_.pending,
+                 (unsigned long)(resume_stats_.pending + resume_stats_.resumed));
     }
 }
 
-void BridgeState::update_matter_attributes(BridgeDevice &dev)
+void BridgeState::update_matter_attributes(BridgeDevice &dev, bool include_relay)
 {
-    // Update temperature on temp sensor endpoint
-    if (dev.persisted.temperature.has_value() && dev.temp_device && dev.temp_device->endpoint) {
-        uint16_t ep_id = endpoint::get_id(dev.temp_device->endpoint);
-        int16_t temp_val = static_cast<int16_t>(dev.persisted.temperature.value() * 100);
-        esp_matter_attr_val_t val = esp_matter_nullable_int16(temp_val);
-        attribute::update(ep_id, chip::app::Clusters::TemperatureMeasurement::Id,
-                          chip::app::Clusters::TemperatureMeasurement::Attributes::MeasuredValue::Id, &val);
-        ESP_LOGI(TAG, "Updated temperature on endpoint %u: %.1fC", ep_id, dev.persisted.temperature.value());
+    const BridgeDeviceState &p = dev.persisted;
+
+    // The published_* copies only advance when the publisher accepts the value,
+    // so a value refused by a full queue goes out with the next report
+
+    // Temperature on the temp sensor endpoint (stale devices keep showing null until they report)
+    if (p.has_temperature() && dev.endpoint_live(BRIDGE_EP_TEMP) && !dev.stale) {
+        if ((dev.published_flags & BridgeDeviceState::HAS_TEMPERATURE) &&
+            abs(p.temperature_centi - dev.published_temp_centi) < CONFIG_BRIDGE_PUBLISH_TEMP_EPSILON_CENTI) {
+            publish_avoided_++;
+        } else if (publisher_.post(p.temp_endpoint_id, BridgeAttr::TEMPERATURE, p.temperature_centi)) {
+            dev.published_temp_centi = p.temperature_centi;
+            dev.published_flags |= BridgeDeviceState::HAS_TEMPERATURE;
+            DLOGI(TAG, "Publishing temperature on endpoint %u: %.2fC", p.temp_endpoint_id, p.temperature());
+        }
     }
 
-    // Update humidity on humidity sensor endpoint
-    if (dev.persisted.humidity.has_value() && dev.humidity_device && dev.humidity_device->endpoint) {
-        uint16_t ep_id = endpoint::get_id(dev.humidity_device->endpoint);
-        uint16_t humidity_val = static_cast<uint16_t>(dev.persisted.humidity.value() * 100);
-        esp_matter_attr_val_t val = esp_matter_nullable_uint16(humidity_val);
-        attribute::update(ep_id, chip::app::Clusters::RelativeHumidityMeasurement::Id,
-                          chip::app::Clusters::RelativeHumidityMeasurement::Attributes::MeasuredValue::Id, &val);
-        ESP_LOGI(TAG, "Updated humidity on endpoint %u: %.1f%%", ep_id, dev.persisted.humidity.value());
+    // Humidity on the humidity sensor endpoint
+    if (p.has_humidity() && dev.endpoint_live(BRIDGE_EP_HUMIDITY) && !dev.stale) {
+        if ((dev.published_flags & BridgeDeviceState::HAS_HUMIDITY) &&
+            abs(p.humidity_centi - dev.published_humidity_centi) < CONFIG_BRIDGE_PUBLISH_HUMIDITY_EPSILON_CENTI) {
+            publish_avoided_++;
+        } else if (publisher_.post(p.humidity_endpoint_id, BridgeAttr::HUMIDITY, p.humidity_centi)) {
+            dev.published_humidity_centi = p.humidity_centi;
+            dev.published_flags |= BridgeDeviceState::HAS_HUMIDITY;
+            DLOGI(TAG, "Publishing humidity on endpoint %u: %.2f%%", p.humidity_endpoint_id, p.humidity());
+        }
     }
 
-    // Update relay state on plug endpoint
-    if (dev.persisted.relay_state.has_value() && dev.plug_device && dev.plug_device->endpoint) {
-        uint16_t ep_id = endpoint::get_id(dev.plug_device->endpoint);
-        esp_matter_attr_val_t val = esp_matter_bool(dev.persisted.relay_state.value());
-        attribute::update(ep_id, chip::app::Clusters::OnOff::Id,
-                          chip::app::Clusters::OnOff::Attributes::OnOff::Id, &val);
-        ESP_LOGI(TAG, "Updated relay on endpoint %u: %s", ep_id, dev.persisted.relay_state.value() ? "ON" : "OFF");
+    // Relay state on the plug endpoint (exact)
+    if (include_relay && p.has_relay_state() && dev.endpoint_live(BRIDGE_EP_PLUG)) {
+        const uint8_t relay_bits = BridgeDeviceState::HAS_RELAY_STATE | BridgeDeviceState::RELAY_ON;
+        if ((dev.published_flags & relay_bits) == (p.flags & relay_bits)) {
+            publish_avoided_++;
+        } else if (publisher_.post(p.plug_endpoint_id, BridgeAttr::ON_OFF, p.relay_state())) {
+            dev.published_flags = static_cast<uint8_t>((dev.published_flags & ~relay_bits) | (p.flags & relay_bits));
+            DLOGI(TAG, "Publishing relay on endpoint %u: %s", p.plug_endpoint_id, p.relay_state() ? "ON" : "OFF");
+        }
+    }
+}
+
+void BridgeState::update_reachable(BridgeDevice &dev)
+{
+    for (int k = 0; k < BRIDGE_EP_COUNT; k++) {
+        BridgeEndpointKind kind = static_cast<BridgeEndpointKind>(k);
+        if (!dev.endpoint_live(kind)) continue;
+
+        bool reachable = !dev.stale &&
+                         !(kind == BRIDGE_EP_PLUG && dev.cmd_schedule.state == ReconcileState::UNCONFIRMED);
+        bool shown_reachable = !(dev.unreachable_eps & (1u << kind));
+        if (reachable == shown_reachable) continue;
+
+        // A refused post leaves the shown state as is; the next call retries it
+        if (publisher_.post(dev.endpoint_id(kind), BridgeAttr::REACHABLE, reachable)) {
+            dev.unreachable_eps ^= 1u << kind;
+        }
     }
 }
 
@@ -335,51 +473,407 @@ void BridgeState::queue_cmd(uint16_t endpoint_id, bool relay_state)
 {
     BridgeDevice *dev = find_by_plug_endpoint(endpoint_id);
     if (!dev) {
-        ESP_LOGW(TAG, "queue_cmd: plug endpoint %u not found", endpoint_id);
+        DLOGW(TAG, "queue_cmd: plug endpoint %u not found", endpoint_id);
         return;
     }
 
-    dev->cmd_pending = true;
-    dev->cmd_relay_state = relay_state;
+    // Last writer wins - a newer write replaces a desired state not yet confirmed
+    uint32_t now_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    dispatcher_.on_write(dev->cmd_schedule, relay_state, now_ms);
+    arm_reconcile(*dev, now_ms);
+
+    // Matter already shows the written value - a report that disagrees must be republished
+    dev->published_flags = static_cast<uint8_t>(
+        (dev->published_flags & ~BridgeDeviceState::RELAY_ON) | BridgeDeviceState::HAS_RELAY_STATE |
+        (relay_state ? BridgeDeviceState::RELAY_ON : 0));
+
+    DLOGI(TAG, "Desired relay for '%s': %s%s", dev->persisted.device_id, relay_state ? "ON" : "OFF",
+          dev->cmd_schedule.state == ReconcileState::PENDING ? "" : " (already reported)");
+}
+
+void BridgeState::run_timers()
+{
+    uint32_t now_ms = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+    uint32_t tick = static_cast<uint32_t>(esp_timer_get_time() / (CONFIG_BRIDGE_TIMER_TICK_MS * 1000LL));
+
+    timers_.advance(tick, [&](uint16_t id) {
+        BridgeDevice &dev = devices_.at(id / BRIDGE_TIMER_KINDS);
+        switch (static_cast<BridgeTimerKind>(id % BRIDGE_TIMER_KINDS)) {
+            case BRIDGE_TIMER_RECONCILE:
+                on_reconcile_timer(dev, now_ms);
+                break;
+            case BRIDGE_TIMER_LIVENESS:
+                on_liveness_timer(dev);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+void BridgeState::arm_reconcile(BridgeDevice &dev, uint32_t now_ms)
+{
+    uint16_t id = timer_id(dev, BRIDGE_TIMER_RECONCILE);
+    uint32_t at = dispatcher_.next_timer_ms(dev.cmd_schedule, now_ms);
+    if (at == CommandDispatcher::NEVER) {
+        timers_.cancel(id);
+        return;
+    }
+
+    timers_.arm(id, ms_to_ticks(static_cast<int32_t>(at - now_ms)));
+}
+
+void BridgeState::on_reconcile_timer(BridgeDevice &dev, uint32_t now_ms)
+{
+    switch (dispatcher_.on_timer(dev.cmd_schedule, now_ms)) {
+        case CommandDispatcher::Action::SEND:
+            send_relay_command(dev, now_ms);
+            break;
+
+        case CommandDispatcher::Action::EXPIRE:
+            // Stop claiming the desired state: show the reported one and flag the plug
+            ESP_LOGW(TAG, "Relay %s for '%s' unconfirmed after %u sends - showing reported state",
+                     dev.cmd_schedule.desired ? "ON" : "OFF", dev.persisted.device_id, dev.cmd_schedule.attempts);
+            if (dev.persisted.has_relay_state()) {
+                dev.published_flags = static_cast<uint8_t>(dev.published_flags & ~BridgeDeviceState::HAS_RELAY_STATE);
+                update_matter_attributes(dev);
+            }
+            update_reachable(dev);
+            break;
 
-    ESP_LOGI(TAG, "Queued command for '%s': relay=%s",
-             dev->persisted.device_id.c_str(), relay_state ? "ON" : "OFF");
+        case CommandDispatcher::Action::NONE:
+            break;
+    }
+    arm_reconcile(dev, now_ms);
 }
 
-void BridgeState::send_pending_command(BridgeDevice &dev)
+void BridgeState::send_relay_command(BridgeDevice &dev, uint32_t now_ms)
 {
-    ESP_LOGI(TAG, "Sending command to '%s': relay=%s",
-             dev.persisted.device_id.c_str(), dev.cmd_relay_state ? "ON" : "OFF");
+    bool relay_state = dev.cmd_schedule.desired;
+    DLOGI(TAG, "Sending command to '%s': relay=%s (attempt %u)",
+          dev.persisted.device_id, relay_state ? "ON" : "OFF", dev.cmd_schedule.attempts + 1);
 
     thread_comms_relay_cmd_t cmd = {};
-    strncpy(cmd.device_id, dev.persisted.device_id.c_str(), sizeof(cmd.device_id) - 1);
-    cmd.relay_state = dev.cmd_relay_state;
+    strlcpy(cmd.device_id, dev.persisted.device_id, sizeof(cmd.device_id));
+    cmd.relay_state = relay_state;
 
     esp_err_t err = thread_comms_send_relay_cmd(&cmd);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send command to '%s': %s",
-                 dev.persisted.device_id.c_str(), esp_err_to_name(err));
+                 dev.persisted.device_id, esp_err_to_name(err));
     }
+    dispatcher_.on_sent(dev.cmd_schedule, now_ms);
 }
 
-BridgeDevice *BridgeState::find_by_device_id(const char *device_id)
+void BridgeState::schedule_report_slot(BridgeDevice &dev)
 {
-    if (!device_id) return nullptr;
+#if CONFIG_BRIDGE_SLOT_SCHEDULE
+    thread_comms_schedule_t schedule;
+    if (!slots_.on_wake(dev.report_slot, dev.persisted.device_id, esp_timer_get_time() / 1000, &schedule)) return;
 
-    for (auto &dev : devices_) {
-        if (dev.persisted.device_id == device_id) {
-            return &dev;
+    DLOGI(TAG, "Sending '%s' report slot %lu: next in %lu ms, every %lu ms", dev.persisted.device_id,
+          (unsigned long)schedule.slot, (unsigned long)schedule.next_slot_ms, (unsigned long)schedule.period_ms);
+    esp_err_t err = thread_comms_send_schedule(&schedule);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to send report slot to '%s': %s", dev.persisted.device_id, esp_err_to_name(err));
+        dev.report_slot.wakes_since_sent = CONFIG_BRIDGE_SLOT_RESYNC;   // Retry at the next wake
+    }
+#endif
+}
+
+uint16_t BridgeState::timer_id(const BridgeDevice &dev, BridgeTimerKind kind) const
+{
+    return static_cast<uint16_t>(devices_.index_of(&dev) * BRIDGE_TIMER_KINDS + kind);
+}
+
+// Deadline: a few missed reports at the learned interval (the wake period for
+// sleepy devices), never below CONFIG_BRIDGE_LIVENESS_MIN_S
+void BridgeState::arm_liveness(BridgeDevice &dev)
+{
+    uint32_t expected_ms = dev.cmd_schedule.sleepy && dev.cmd_schedule.period_ms ? dev.cmd_schedule.period_ms
+                                                                                  : dev.report_period_ms;
+    uint64_t timeout_ms = expected_ms ? static_cast<uint64_t>(expected_ms) * CONFIG_BRIDGE_LIVENESS_MISSED_REPORTS
+                                      : CONFIG_BRIDGE_LIVENESS_DEFAULT_S * 1000ULL;
+    if (timeout_ms < CONFIG_BRIDGE_LIVENESS_MIN_S * 1000ULL) {
+        timeout_ms = CONFIG_BRIDGE_LIVENESS_MIN_S * 1000ULL;
+    }
+    if (timeout_ms > INT32_MAX) {
+        timeout_ms = INT32_MAX;
+    }
+    timers_.arm(timer_id(dev, BRIDGE_TIMER_LIVENESS), ms_to_ticks(static_cast<int32_t>(timeout_ms)));
+}
+
+void BridgeState::on_liveness_timer(BridgeDevice &dev)
+{
+    if (dev.stale) return;
+
+    dev.stale = true;
+    liveness_stats_.stale++;
+    liveness_stats_.expired++;
+    uint32_t silent_s = (static_cast<uint32_t>(esp_timer_get_time() / 1000) - dev.last_seen_ms) / 1000;
+    ESP_LOGW(TAG, "'%s' silent for %lu s - marking unreachable", dev.persisted.device_id, (unsigned long)silent_s);
+
+    // Stop showing old readings; clearing the published flags makes the next
+    // report republish them regardless of epsilon
+    if ((dev.published_flags & BridgeDeviceState::HAS_TEMPERATURE) && dev.endpoint_live(BRIDGE_EP_TEMP)) {
+        publisher_.post(dev.persisted.temp_endpoint_id, BridgeAttr::TEMPERATURE, BRIDGE_ATTR_NULL);
+    }
+    if ((dev.published_flags & BridgeDeviceState::HAS_HUMIDITY) && dev.endpoint_live(BRIDGE_EP_HUMIDITY)) {
+        publisher_.post(dev.persisted.humidity_endpoint_id, BridgeAttr::HUMIDITY, BRIDGE_ATTR_NULL);
+    }
+    dev.published_flags &= static_cast<uint8_t>(~(BridgeDeviceState::HAS_TEMPERATURE | BridgeDeviceState::HAS_HUMIDITY));
+
+    // A device that left no longer loads its report slot
+    slots_.release(dev.report_slot);
+
+    update_reachable(dev);
+}
+
+void BridgeState::log_command_stats()
+{
+    dispatcher_.log_stats();
+#if CONFIG_BRIDGE_SLOT_SCHEDULE
+    slots_.log_stats();
+#endif
+    ESP_LOGI(TAG, "Liveness: %lu of %u devices stale, %lu expiries, %lu recoveries, %lu timers armed",
+             (unsigned long)liveness_stats_.stale, devices_.size(), (unsigned long)liveness_stats_.expired,
+             (unsigned long)liveness_stats_.recovered, (unsigned long)timers_.armed_count());
+}
+
+// thread_comms reads clock error below 0 as 0; error_us says how far to trust it
+void BridgeState::record_latency(BridgeDevice &dev, int32_t latency_us, uint32_t error_us)
+{
+    uint32_t ms = static_cast<uint32_t>(latency_us) / 1000;
+    dev.latency_ms.record(ms);
+    latency_stats_.ms.record(ms);
+    latency_stats_.error_ms.record(error_us / 1000);
+}
+
+void BridgeState::log_latency_stats()
+{
+    const LatencyHistogram &all = latency_stats_.ms;
+    const LatencyHistogram &error = latency_stats_.error_ms;
+    ESP_LOGI(TAG, "Report latency (n=%lu): p50 <%lu ms, p90 <%lu ms, p99 <%lu ms, max %lu ms; %lu unstamped",
+             (unsigned long)all.count(), (unsigned long)all.percentile(50), (unsigned long)all.percentile(90),
+             (unsigned long)all.percentile(99), (unsigned long)all.max(), (unsigned long)latency_stats_.unstamped);
+    if (all.count() == 0) return;
+    ESP_LOGI(TAG, "  +/- error bound:  p50 <%lu ms, p90 <%lu ms, p99 <%lu ms, max %lu ms",
+             (unsigned long)error.percentile(50), (unsigned long)error.percentile(90),
+             (unsigned long)error.percentile(99), (unsigned long)error.max());
+
+    // Slowest devices by p90 (typically the ones furthest from the router)
+    constexpr int WORST = 3;
+    const BridgeDevice *worst[WORST] = {};
+    for (const auto &dev : devices_) {
+        if (dev.latency_ms.count() == 0) continue;
+        uint32_t p90 = dev.latency_ms.percentile(90);
+        for (int i = 0; i < WORST; i++) {
+            if (!worst[i] || p90 > worst[i]->latency_ms.percentile(90)) {
+                for (int j = WORST - 1; j > i; j--) {
+                    worst[j] = worst[j - 1];
+                }
+                worst[i] = &dev;
+                break;
+            }
         }
     }
-    return nullptr;
+    for (const BridgeDevice *dev : worst) {
+        if (!dev) break;
+        const SmallLatencyHistogram &h = dev->latency_ms;
+        ESP_LOGI(TAG, "  '%s' (n=%lu): p50 <%lu ms, p90 <%lu ms, max %lu ms", dev->persisted.device_id,
+                 (unsigned long)h.count(), (unsigned long)h.percentile(50), (unsigned long)h.percentile(90),
+                 (unsigned long)h.max());
+    }
 }
 
-BridgeDevice *BridgeState::find_by_plug_endpoint(uint16_t endpoint_id)
+void BridgeState::log_delivery_stats()
 {
+    delivery_.log_stats();
+
+    // Worst links by delivery ratio
+    constexpr int WORST = 3;
+    const BridgeDevice *worst[WORST] = {};
+    for (const auto &dev : devices_) {
+        if (dev.delivery.lost == 0) continue;
+        uint32_t pdr = dev.delivery.pdr_permille();
+        for (int i = 0; i < WORST; i++) {
+            if (!worst[i] || pdr < worst[i]->delivery.pdr_permille()) {
+                for (int j = WORST - 1; j > i; j--) {
+                    worst[j] = worst[j - 1];
+                }
+                worst[i] = &dev;
+                break;
+            }
+        }
+    }
+    for (const BridgeDevice *dev : worst) {
+        if (!dev) break;
+        const DeliveryState &d = dev->delivery;
+        uint32_t pdr = d.pdr_permille();
+        ESP_LOGI(TAG, "  '%s': PDR %lu.%lu%% (%lu received, %lu lost), %u duplicates, %u reordered, %u restarts",
+                 dev->persisted.device_id, (unsigned long)(pdr / 10), (unsigned long)(pdr % 10),
+                 (unsigned long)d.received, (unsigned long)d.lost, d.duplicates, d.reordered, d.restarts);
+    }
+}
+
+void BridgeState::flush_dirty()
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t saved = 0;
+
+    for (auto &dev : devices_) {
+        if (!dev.dirty) continue;
+
+        esp_err_t err = bridge_nvs_save_device(dev.persisted, false);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to flush device '%s': %s",
+                     dev.persisted.device_id, esp_err_to_name(err));
+            continue;
+        }
+        dev.flushing = true;
+        saved++;
+    }
+
+    if (saved == 0) return;
+
+    // Values are only safe once committed - a failed commit leaves them dirty for the next flush
+    esp_err_t err = bridge_nvs_commit();
     for (auto &dev : devices_) {
-        if (dev.persisted.plug_endpoint_id == endpoint_id) {
-            return &dev;
+        if (!dev.flushing) continue;
+        dev.flushing = false;
+        if (err == ESP_OK) {
+            dev.dirty = false;
         }
     }
-    return nullptr;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit %lu flushed devices: %s", (unsigned long)saved, esp_err_to_name(err));
+        return;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    persist_stats_.flushed += saved;
+    persist_stats_.flushes++;
+    persist_stats_.flush_us_total += elapsed_us;
+    if (elapsed_us > persist_stats_.flush_us_max) {
+        persist_stats_.flush_us_max = elapsed_us;
+    }
+    ESP_LOGI(TAG, "Flushed %lu devices to NVS in %lld us", (unsigned long)saved, (long long)elapsed_us);
+}
+
+void BridgeState::log_persist_stats()
+{
+    const BridgeNvsStats &nvs = bridge_nvs_get_stats();
+    int64_t uptime_s = esp_timer_get_time() / 1000000;
+
+    ESP_LOGI(TAG, "Persistence: %lu immediate saves, %lu flushed, %lu coalesced, %lu NVS writes",
+             (unsigned long)persist_stats_.immediate, (unsigned long)persist_stats_.flushed,
+             (unsigned long)persist_stats_.coalesced, (unsigned long)nvs.writes);
+    ESP_LOGI(TAG, "  %lu bytes written (%lld bytes/hour), %lu commits, flush avg %lld us max %lld us",
+             (unsigned long)nvs.bytes,
+             (long long)(uptime_s > 0 ? (int64_t)nvs.bytes * 3600 / uptime_s : 0),
+             (unsigned long)nvs.commits,
+             (long long)(persist_stats_.flushes ? persist_stats_.flush_us_total / persist_stats_.flushes : 0),
+             (long long)persist_stats_.flush_us_max);
+    bridge_matter_persist_log_stats();
+}
+
+BridgeDevice *BridgeState::alloc_device(const char *device_id)
+{
+    BridgeDevice *dev = devices_.alloc();
+    if (!dev) return nullptr;
+
+    dev->persisted.set_device_id(device_id);
+    by_device_id_.insert(bridge_hash_device_id(device_id), devices_.index_of(dev));
+    return dev;
+}
+
+void BridgeState::log_publish_stats()
+{
+    AttributePublisher::Stats s = publisher_.stats();
+
+    ESP_LOGI(TAG, "Matter publish: %lu changed, %lu avoided (within epsilon), %lu coalesced, %lu updates in %lu batches",
+             (unsigned long)s.posted, (unsigned long)publish_avoided_, (unsigned long)s.coalesced,
+             (unsigned long)s.published, (unsigned long)s.batches);
+    ESP_LOGI(TAG, "  CHIP lock held avg %lld us max %lld us per batch, %lu schedule failures, %lu dropped",
+             (long long)(s.batches ? s.lock_us_total / s.batches : 0), (long long)s.lock_us_max,
+             (unsigned long)s.schedule_failures, (unsigned long)s.dropped);
+    if (AllocCounter::enabled()) {
+        ESP_LOGI(TAG, "  %lu heap allocations on the CHIP thread for %lu updates",
+                 (unsigned long)s.allocs, (unsigned long)s.published);
+    }
+}
+
+void BridgeState::log_provision_stats()
+{
+    provisioner_.log_stats();
+    if (provision_latency_ms_.count() == 0) return;
+    ESP_LOGI(TAG, "  first report to values published: p50 <%lu ms, p90 <%lu ms, max %lu ms",
+             (unsigned long)provision_latency_ms_.percentile(50), (unsigned long)provision_latency_ms_.percentile(90),
+             (unsigned long)provision_latency_ms_.max());
+}
+
+void BridgeState::log_memory_footprint() const
+{
+    // Pool storage + free list/generations, and both indexes pre-sized for a full pool
+    size_t total = sizeof(devices_) + by_device_id_.memory_bytes() + by_endpoint_.memory_bytes();
+    size_t per_device = total / devices_.capacity();
+
+    ESP_LOGI(TAG, "Device record: %u bytes (%u persisted), %u bytes/device with pool and indexes",
+             (unsigned)sizeof(BridgeDevice), (unsigned)sizeof(BridgeDeviceState), (unsigned)per_device);
+    ESP_LOGI(TAG, "Device pool: %u slots = %u bytes; %u devices fit in %u KB",
+             devices_.capacity(), (unsigned)total,
+             (unsigned)(CONFIG_BRIDGE_DEVICE_RAM_BUDGET_KB * 1024 / per_device),
+             (unsigned)CONFIG_BRIDGE_DEVICE_RAM_BUDGET_KB);
+}
+
+BridgeDevice *BridgeState::get(BridgeDeviceHandle handle)
+{
+    return devices_.get(handle);
+}
+
+BridgeDeviceHandle BridgeState::handle_of(const BridgeDevice &dev) const
+{
+    return devices_.handle_of(&dev);
+}
+
+void BridgeState::index_endpoints(BridgeDevice &dev)
+{
+    uint16_t slot = devices_.index_of(&dev);
+    const uint16_t endpoint_ids[] = {
+        dev.persisted.plug_endpoint_id,
+        dev.persisted.temp_endpoint_id,
+        dev.persisted.humidity_endpoint_id,
+    };
+
+    for (uint16_t ep_id : endpoint_ids) {
+        if (ep_id != 0 && !find_by_endpoint(ep_id)) {
+            by_endpoint_.insert(bridge_hash_endpoint_id(ep_id), slot);
+        }
+    }
+}
+
+BridgeDevice *BridgeState::find_by_device_id(const char *device_id)
+{
+    if (!device_id) return nullptr;
+
+    uint16_t slot = by_device_id_.find(bridge_hash_device_id(device_id), [&](uint16_t s) {
+        return strcmp(devices_.at(s).persisted.device_id, device_id) == 0;
+    });
+    return slot != SlotIndex::NO_SLOT ? &devices_.at(slot) : nullptr;
+}
+
+BridgeDevice *BridgeState::find_by_endpoint(uint16_t endpoint_id)
+{
+    uint16_t slot = by_endpoint_.find(bridge_hash_endpoint_id(endpoint_id), [&](uint16_t s) {
+        const BridgeDeviceState &p = devices_.at(s).persisted;
+        return p.plug_endpoint_id == endpoint_id || p.temp_endpoint_id == endpoint_id ||
+               p.humidity_endpoint_id == endpoint_id;
+    });
+    return slot != SlotIndex::NO_SLOT ? &devices_.at(slot) : nullptr;
+}
+
+BridgeDevice *BridgeState::find_by_plug_endpoint(uint16_t endpoint_id)
+{
+    BridgeDevice *dev = find_by_endpoint(endpoint_id);
+    return (dev && dev->persisted.plug_endpoint_id == endpoint_id) ? dev : nullptr;
 }
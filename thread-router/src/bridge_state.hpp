@@ -1,6 +1,15 @@
 #pragma once
 
+#include "bridge_delivery.hpp"
+#include "bridge_dispatch.hpp"
+#include "bridge_index.hpp"
+#include "bridge_events.hpp"
 #include "bridge_nvs.hpp"
+#include "bridge_provision.hpp"
+#include "bridge_publish.hpp"
+#include "bridge_schedule.hpp"
+#include "slab_pool.hpp"
+#include "timer_wheel.hpp"
 
 #include <vector>
 #include <cstdint>
@@ -20,35 +29,90 @@ extern "C" {
 struct BridgeDevice {
     BridgeDeviceState persisted;    // From our NVS
 
-    // Runtime only - Matter device handles for each capability
-    esp_matter_bridge::device_t *plug_device = nullptr;
-    esp_matter_bridge::device_t *temp_device = nullptr;
-    esp_matter_bridge::device_t *humidity_device = nullptr;
+    // Runtime only
+    uint32_t last_seen_ms = 0;      // Low 32 bits of uptime - compare with unsigned subtraction
+    uint32_t report_period_ms = 0;  // EWMA of report-to-report intervals (0 = not learned yet)
+    uint8_t endpoints_live = 0;     // Bit per BridgeEndpointKind whose Matter endpoint is enabled
+    uint8_t unreachable_eps = 0;    // Bit per BridgeEndpointKind published as Reachable = false
+
+    // Last values handed to Matter (BridgeDeviceState flag bits), for change-only publishing
+    int16_t published_temp_centi = 0;
+    uint16_t published_humidity_centi = 0;
+    uint8_t published_flags = 0;
+
+    CommandSchedule cmd_schedule;   // Desired vs reported relay state, wake schedule
+    SlotState report_slot;          // Assigned report slot (sleepy devices)
+    SmallLatencyHistogram latency_ms;   // One-way report latency (network time stamped reports)
+    DeliveryState delivery;         // Received / lost / duplicate / reordered reports
+
+    // Zeroed by value-initialization in SlabPool::alloc()
+    bool nvs_key_collision : 1;     // Another device owns this NVS key - not persisted
+    bool dirty : 1;                 // Sensor values changed since the last NVS save
+    bool flushing : 1;              // Saved by flush_dirty(), waiting for its commit
+    bool resume_pending : 1;        // Loaded from NVS, Matter endpoints not resumed yet
+    bool provisioning : 1;          // Endpoint creation queued on the provisioning worker
+    bool stale : 1;                 // Missed its liveness deadline - sensor values shown as null
+
+    bool endpoint_live(BridgeEndpointKind kind) const { return endpoints_live & (1u << kind); }
+    uint16_t endpoint_id(BridgeEndpointKind kind) const;
+};
 
-    int64_t last_seen_ms = 0;
-    bool cmd_pending = false;
-    bool cmd_relay_state = false;
+// Per-device timers in BridgeState's wheel (timer id = slot * BRIDGE_TIMER_KINDS + kind)
+enum BridgeTimerKind : uint8_t {
+    BRIDGE_TIMER_RECONCILE,
+    BRIDGE_TIMER_LIVENESS,          // Re-armed by every report from the expected report interval
+    BRIDGE_TIMER_KINDS,
 };
 
+// Generation-checked reference to a BridgeDevice that can be held across calls
+using BridgeDeviceHandle = SlabHandle;
+
+// Owned by the bridge task: every method except device_type_callback must be
+// called from it (inputs from other tasks arrive as BridgeEvents)
 class BridgeState {
 public:
     // Initialize bridge state - call after esp_matter::start()
     // aggregator_endpoint_id: the Matter aggregator endpoint ID
-    esp_err_t init(esp_matter::node_t *node, uint16_t aggregator_endpoint_id);
+    // events: the bridge task's queue, for provisioning results
+    esp_err_t init(esp_matter::node_t *node, uint16_t aggregator_endpoint_id, BridgeEventQueue &events);
+
+    // Resume Matter endpoints of up to max_devices loaded devices under one
+    // CHIP stack lock; returns how many are still waiting (0 = done)
+    size_t resume_batch(size_t max_devices);
 
-    // Called from Thread message callback
-    void on_report(const thread_comms_report_t *report);
+    // Device report (BridgeEventType::REPORT)
+    void on_report(const BridgeEvent &event);
+    void log_latency_stats();
+    void log_delivery_stats();
 
-    // Called from Matter PRE_UPDATE callback for OnOff cluster
+    // Endpoints created for a new device (BridgeEventType::PROVISIONED)
+    void on_provisioned(const BridgeEvent &event);
+    void log_provision_stats();
+
+    // Controller write of a plug's OnOff attribute (BridgeEventType::ON_OFF_WRITE)
+    // Sets the desired relay state - the reconcile timer sends it
     void queue_cmd(uint16_t endpoint_id, bool relay_state);
 
-    // Flag to skip attribute callbacks during our own updates
-    bool updating_from_thread = false;
+    // Advance the device timer wheel to now (call every CONFIG_BRIDGE_TIMER_TICK_MS,
+    // and after each event batch so zero-delay timers run right away)
+    void run_timers();
+    void log_command_stats();
+
+    // Write-behind persistence - save devices with unsaved sensor values
+    // (sensor-only changes are not written by on_report unless BRIDGE_NVS_FLUSH_INTERVAL_S is 0)
+    void flush_dirty();
+    void log_persist_stats();
+    void log_publish_stats();
 
-    // Lookup
+    // Lookup (hash indexed)
     BridgeDevice *find_by_device_id(const char *device_id);
+    BridgeDevice *find_by_endpoint(uint16_t endpoint_id);
     BridgeDevice *find_by_plug_endpoint(uint16_t endpoint_id);
 
+    // Handles stay valid until the device is freed; get() returns nullptr after that
+    BridgeDevice *get(BridgeDeviceHandle handle);
+    BridgeDeviceHandle handle_of(const BridgeDevice &dev) const;
+
     // Device type callback for esp_matter_bridge
     static esp_err_t device_type_callback(esp_matter::endpoint_t *ep,
                                           uint32_t device_type_id,
@@ -57,19 +121,87 @@ public:
 private:
     esp_matter::node_t *node_;
     uint16_t aggregator_endpoint_id_;
-    std::vector<BridgeDevice> devices_;
-
-    // Matter endpoint lifecycle - creates/resumes all endpoints for a device
-    void create_endpoints_for_device(BridgeDevice &dev, const thread_comms_report_t *report);
+    // Fixed pool - addresses are stable and slot indexes double as index values
+    SlabPool<BridgeDevice, CONFIG_BRIDGE_MAX_DEVICES> devices_;
+
+    // Indexes into devices_: full device id, and every endpoint id (plug, temp, humidity)
+    SlotIndex by_device_id_;
+    SlotIndex by_endpoint_;
+
+    struct PersistStats {
+        uint32_t immediate = 0;     // Saved right away (new endpoint ids)
+        uint32_t flushed = 0;       // Saved by flush_dirty
+        uint32_t coalesced = 0;     // Changes folded into an already pending save
+        uint32_t flushes = 0;
+        int64_t flush_us_total = 0;
+        int64_t flush_us_max = 0;
+    };
+    PersistStats persist_stats_;
+
+    struct ResumeStats {
+        uint32_t pending = 0;       // Loaded devices waiting for endpoint resume
+        uint32_t resumed = 0;
+        uint32_t on_demand = 0;     // Resumed early because a report arrived
+        uint32_t batches = 0;
+        int64_t start_us = 0;
+        int64_t lock_us_max = 0;    // Longest CHIP stack lock hold for one batch
+    };
+    ResumeStats resume_stats_;
+    bool first_report_logged_ = false;
+
+    CommandDispatcher dispatcher_;
+    SlotScheduler slots_;
+    TimerWheel<CONFIG_BRIDGE_MAX_DEVICES * BRIDGE_TIMER_KINDS> timers_;
+
+    struct LivenessStats {
+        uint32_t stale = 0;         // Devices currently past their deadline
+        uint32_t expired = 0;
+        uint32_t recovered = 0;     // Stale devices that reported again
+    };
+    LivenessStats liveness_stats_;
+
+    EndpointProvisioner provisioner_;
+    LatencyHistogram provision_latency_ms_;     // Endpoints queued to values published
+
+    struct LatencyStats {
+        LatencyHistogram ms;        // One-way report latency, all devices
+        LatencyHistogram error_ms;  // Error bound of each latency sample
+        uint32_t unstamped = 0;     // Reports without network time
+    };
+    LatencyStats latency_stats_;
+    DeliveryTracker delivery_;
+    void record_latency(BridgeDevice &dev, int32_t latency_us, uint32_t error_us);
+
+    AttributePublisher publisher_;
+    uint32_t publish_avoided_ = 0;  // Values within epsilon of what Matter already shows
+
+    BridgeDevice *alloc_device(const char *device_id);   // nullptr when the pool is full
+    void log_memory_footprint() const;
+    void index_endpoints(BridgeDevice &dev);
+
+    // Matter endpoint lifecycle - queues creation of missing endpoints on the
+    // provisioning worker; resumes all endpoints of a device (caller holds the CHIP stack lock)
+    void request_endpoints(BridgeDevice &dev, const thread_comms_report_t *report);
     void resume_endpoints_for_device(BridgeDevice &dev);
 
-    // Single endpoint helpers
-    esp_matter_bridge::device_t *create_single_endpoint(BridgeDevice &dev, uint32_t device_type_id, const char *label_suffix);
-    esp_matter_bridge::device_t *resume_single_endpoint(BridgeDevice &dev, uint16_t endpoint_id, const char *label_suffix);
+    // Single endpoint resume - returns the endpoint id, 0 on failure
+    uint16_t resume_single_endpoint(BridgeDevice &dev, BridgeEndpointKind kind);
+
+    // Attribute updates - posts values that moved past their epsilon
+    void update_matter_attributes(BridgeDevice &dev, bool include_relay = true);
+    // Publish Reachable per endpoint: false while stale, and on the plug while its relay state is unconfirmed
+    void update_reachable(BridgeDevice &dev);
+
+    // Relay reconciliation
+    uint16_t timer_id(const BridgeDevice &dev, BridgeTimerKind kind) const;
+    void arm_reconcile(BridgeDevice &dev, uint32_t now_ms);
+    void on_reconcile_timer(BridgeDevice &dev, uint32_t now_ms);
+    void send_relay_command(BridgeDevice &dev, uint32_t now_ms);
 
-    // Attribute updates
-    void update_matter_attributes(BridgeDevice &dev);
+    // Report slots - (re)send a sleepy device its slot at the start of a wake
+    void schedule_report_slot(BridgeDevice &dev);
 
-    // Command delivery
-    void send_pending_command(BridgeDevice &dev);
+    // Liveness
+    void arm_liveness(BridgeDevice &dev);
+    void on_liveness_timer(BridgeDevice &dev);
 };
@@ -0,0 +1,505 @@
+#include "bridge_nvs.hpp"
+
+#if CONFIG_BRIDGE_STORE_LOG
+
+#include "bridge_index.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "spi_flash_mmap.h"
+#include "dlog.h"
+#include "event_trace.h"
+
+#include "proto/bridge_nvs.pb.h"
+
+static const char *TAG = "tr-store";
+
+// Log-structured bridge store in a dedicated data partition.
+//
+// The partition is split into two halves; one is active at a time:
+//   [HalfHeader][Record][Record]...[erased 0xFF...]
+// Records are only appended. A DEVICE record supersedes any older record for
+// the same device id, DELETE drops it. When the active half is full, or a
+// write fails part way, the live records are copied to the other half and its
+// header is written last, so a power loss during compaction leaves the old
+// half active.
+//
+// Boot restore memory-maps the partition and decodes records in place.
+
+#define LOG_MAGIC           0x474C5242      // "BRLG"
+#define RECORD_ALIGN        4
+#define MAX_PAYLOAD         BridgeNvsDevice_size
+
+// Live record table, sized at init so saves never allocate
+#if CONFIG_BRIDGE_STORE_BENCHMARK
+#define LIVE_CAPACITY       (CONFIG_BRIDGE_MAX_DEVICES > 1000 ? CONFIG_BRIDGE_MAX_DEVICES : 1000)  // Largest benchmark run
+#else
+#define LIVE_CAPACITY       CONFIG_BRIDGE_MAX_DEVICES
+#endif
+
+struct HalfHeader {
+    uint32_t magic;
+    uint32_t seq;       // Higher = newer
+};
+
+struct RecordHeader {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t len;       // Payload bytes (record is padded to RECORD_ALIGN)
+    uint32_t crc;       // CRC32 of type, reserved, len and payload
+};
+
+enum : uint8_t {
+    RECORD_DEVICE = 1,      // BridgeNvsDevice protobuf
+    RECORD_DELETE = 2,      // Device id string
+    RECORD_ENDPOINTS = 3,   // Obsolete endpoint id reservation - skipped
+    RECORD_ERASED = 0xFF,   // End of log
+};
+
+// Latest DEVICE record for each live device
+struct LiveRecord {
+    uint32_t hash;          // bridge_hash_device_id
+    uint32_t offset;        // Within the active half
+};
+
+static const esp_partition_t *s_part = nullptr;
+static const uint8_t *s_map = nullptr;
+static esp_partition_mmap_handle_t s_map_handle;
+static uint32_t s_half_size = 0;
+static uint32_t s_active = 0;           // 0 or 1
+static uint32_t s_seq = 0;
+static uint32_t s_write_off = 0;        // Append offset within the active half
+
+static std::vector<LiveRecord> s_live;  // Reserved for LIVE_CAPACITY at init
+static SlotIndex s_index;               // Device id hash -> s_live slot
+static uint32_t s_compact_offsets[LIVE_CAPACITY];
+
+static BridgeNvsStats s_stats;
+
+static inline size_t record_size(uint16_t len)
+{
+    return sizeof(RecordHeader) + ((len + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1));
+}
+
+static inline const uint8_t *half_base(uint32_t half)
+{
+    return s_map + half * s_half_size;
+}
+
+static inline const RecordHeader *record_at(uint32_t offset)
+{
+    return reinterpret_cast<const RecordHeader *>(half_base(s_active) + offset);
+}
+
+static uint32_t record_crc(const RecordHeader *hdr, const void *payload)
+{
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(hdr), offsetof(RecordHeader, crc));
+    return esp_rom_crc32_le(crc, static_cast<const uint8_t *>(payload), hdr->len);
+}
+
+static uint16_t find_live(uint32_t hash)
+{
+    return s_index.find(hash, [&](uint16_t slot) { return s_live[slot].hash == hash; });
+}
+
+static void remove_live(uint16_t slot)
+{
+    s_index.erase(s_live[slot].hash, slot);
+
+    uint16_t last = static_cast<uint16_t>(s_live.size() - 1);
+    if (slot != last) {
+        s_index.erase(s_live[last].hash, last);
+        s_live[slot] = s_live[last];
+        s_index.insert(s_live[slot].hash, slot);
+    }
+    s_live.pop_back();
+}
+
+static bool live_full(uint32_t hash)
+{
+    return s_live.size() >= LIVE_CAPACITY && find_live(hash) == SlotIndex::NO_SLOT;
+}
+
+// Caller checks live_full() first
+static void set_live(uint32_t hash, uint32_t offset)
+{
+    uint16_t slot = find_live(hash);
+    if (slot != SlotIndex::NO_SLOT) {
+        s_live[slot].offset = offset;
+    } else {
+        s_index.insert(hash, static_cast<uint16_t>(s_live.size()));
+        s_live.push_back({hash, offset});
+    }
+}
+
+static void reset_live()
+{
+    s_live.clear();
+    s_index.clear();
+    s_live.reserve(LIVE_CAPACITY);
+    s_index.reserve(LIVE_CAPACITY);
+}
+
+/*── Flash ──*/
+
+// Write a record at a given offset of a half (payload copied to RAM first -
+// the source may be memory-mapped flash)
+static esp_err_t write_record(uint32_t half, uint32_t offset, uint8_t type, const void *payload, uint16_t len)
+{
+    uint8_t buf[sizeof(RecordHeader) + MAX_PAYLOAD + RECORD_ALIGN];
+    if (len > MAX_PAYLOAD) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t size = record_size(len);
+    memset(buf, 0xFF, size);
+    RecordHeader *hdr = reinterpret_cast<RecordHeader *>(buf);
+    hdr->type = type;
+    hdr->reserved = 0;
+    hdr->len = len;
+    memcpy(buf + sizeof(RecordHeader), payload, len);
+    hdr->crc = record_crc(hdr, buf + sizeof(RecordHeader));
+
+    return esp_partition_write(s_part, half * s_half_size + offset, buf, size);
+}
+
+static esp_err_t compact();
+
+static esp_err_t append(uint8_t type, const void *payload, uint16_t len, uint32_t *out_offset = nullptr)
+{
+    size_t size = record_size(len);
+    if (s_write_off + size > s_half_size) {
+        esp_err_t err = compact();
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (s_write_off + size > s_half_size) {
+            ESP_LOGE(TAG, "Store full (%lu live records)", (unsigned long)s_live.size());
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    esp_err_t err = write_record(s_active, s_write_off, type, payload, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to append record: %s", esp_err_to_name(err));
+        // The area may be partially programmed. scan() stops at it, so records
+        // appended after it would be lost at the next boot - move the live
+        // records to the other half now instead
+        s_write_off += size;
+        compact();
+        return err;
+    }
+
+    if (out_offset) {
+        *out_offset = s_write_off;
+    }
+    s_write_off += size;
+    s_stats.bytes += size;
+    return ESP_OK;
+}
+
+static esp_err_t write_half_header(uint32_t half, uint32_t seq)
+{
+    HalfHeader header = { LOG_MAGIC, seq };
+    return esp_partition_write(s_part, half * s_half_size, &header, sizeof(header));
+}
+
+// Copy live records into the inactive half and switch to it
+static esp_err_t compact()
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t dst = 1 - s_active;
+
+    esp_err_t err = esp_partition_erase_range(s_part, dst * s_half_size, s_half_size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase half %lu: %s", (unsigned long)dst, esp_err_to_name(err));
+        return err;
+    }
+
+    // New offsets are only applied once the new header is written
+    uint32_t *offsets = s_compact_offsets;
+    uint32_t off = sizeof(HalfHeader);
+
+    for (size_t i = 0; i < s_live.size(); i++) {
+        const RecordHeader *hdr = record_at(s_live[i].offset);
+        err = write_record(dst, off, RECORD_DEVICE, hdr + 1, hdr->len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Compaction failed: %s", esp_err_to_name(err));
+            return err;
+        }
+        offsets[i] = off;
+        off += record_size(hdr->len);
+    }
+
+    err = write_half_header(dst, s_seq + 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (size_t i = 0; i < s_live.size(); i++) {
+        s_live[i].offset = offsets[i];
+    }
+    s_active = dst;
+    s_seq++;
+    s_write_off = off;
+
+    s_stats.compactions++;
+    s_stats.compaction_bytes += off;
+    ESP_LOGI(TAG, "Compacted %lu records into half %lu (%lu/%lu bytes, %lld us)",
+             (unsigned long)s_live.size(), (unsigned long)dst,
+             (unsigned long)off, (unsigned long)s_half_size,
+             (long long)(esp_timer_get_time() - start));
+    return ESP_OK;
+}
+
+// Start a fresh log in half 0
+static esp_err_t format()
+{
+    esp_err_t err = esp_partition_erase_range(s_part, 0, s_half_size * 2);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase store: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    s_seq++;
+    err = write_half_header(0, s_seq);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_active = 0;
+    s_write_off = sizeof(HalfHeader);
+    reset_live();
+    return ESP_OK;
+}
+
+/*── Boot restore ──*/
+
+// Walk the active half and rebuild the live record table; returns false if the
+// log ends in a torn (partially written) record
+static bool scan()
+{
+    const uint8_t *base = half_base(s_active);
+    uint32_t off = sizeof(HalfHeader);
+
+    while (off + sizeof(RecordHeader) <= s_half_size) {
+        const RecordHeader *hdr = reinterpret_cast<const RecordHeader *>(base + off);
+        if (hdr->type == RECORD_ERASED) {
+            break;
+        }
+
+        size_t size = record_size(hdr->len);
+        const uint8_t *payload = base + off + sizeof(RecordHeader);
+        if (off + size > s_half_size || hdr->crc != record_crc(hdr, payload)) {
+            ESP_LOGW(TAG, "Torn record at offset %lu", (unsigned long)off);
+            s_write_off = off;
+            return false;
+        }
+
+        switch (hdr->type) {
+            case RECORD_DEVICE: {
+                auto device = bridge_nvs_decode_device(payload, hdr->len);
+                if (!device.has_value()) {
+                    break;
+                }
+                uint32_t hash = bridge_hash_device_id(device->device_id);
+                if (live_full(hash)) {
+                    ESP_LOGW(TAG, "More than %u devices stored - not restoring '%s'",
+                             (unsigned)LIVE_CAPACITY, device->device_id);
+                    break;
+                }
+                set_live(hash, off);
+                break;
+            }
+            case RECORD_DELETE: {
+                char device_id[BridgeNvsDevice_size];
+                size_t len = hdr->len < sizeof(device_id) - 1 ? hdr->len : sizeof(device_id) - 1;
+                memcpy(device_id, payload, len);
+                device_id[len] = '\0';
+                uint16_t slot = find_live(bridge_hash_device_id(device_id));
+                if (slot != SlotIndex::NO_SLOT) {
+                    remove_live(slot);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        off += size;
+    }
+
+    s_write_off = off;
+    return true;
+}
+
+esp_err_t bridge_nvs_init()
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                      CONFIG_BRIDGE_STORE_PARTITION);
+    if (!s_part) {
+        ESP_LOGE(TAG, "Partition '%s' not found", CONFIG_BRIDGE_STORE_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_half_size = (s_part->size / 2) & ~(SPI_FLASH_SEC_SIZE - 1);
+    if (s_half_size < SPI_FLASH_SEC_SIZE) {
+        ESP_LOGE(TAG, "Partition '%s' too small", CONFIG_BRIDGE_STORE_PARTITION);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const void *map = nullptr;
+    esp_err_t err = esp_partition_mmap(s_part, 0, s_half_size * 2, ESP_PARTITION_MMAP_DATA, &map, &s_map_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mmap '%s': %s", CONFIG_BRIDGE_STORE_PARTITION, esp_err_to_name(err));
+        return err;
+    }
+    s_map = static_cast<const uint8_t *>(map);
+
+    // Pick the newest valid half
+    const HalfHeader *h0 = reinterpret_cast<const HalfHeader *>(half_base(0));
+    const HalfHeader *h1 = reinterpret_cast<const HalfHeader *>(half_base(1));
+    bool valid0 = h0->magic == LOG_MAGIC;
+    bool valid1 = h1->magic == LOG_MAGIC;
+
+    if (!valid0 && !valid1) {
+        ESP_LOGI(TAG, "Formatting store '%s' (%lu bytes)", CONFIG_BRIDGE_STORE_PARTITION,
+                 (unsigned long)s_part->size);
+        return format();
+    }
+    s_active = (valid1 && (!valid0 || h1->seq > h0->seq)) ? 1 : 0;
+    s_seq = s_active ? h1->seq : h0->seq;
+
+    int64_t start = esp_timer_get_time();
+    reset_live();
+    bool clean = scan();
+    ESP_LOGI(TAG, "Store restored: %lu devices, %lu/%lu bytes used, half %lu seq %lu (%lld us)",
+             (unsigned long)s_live.size(), (unsigned long)s_write_off, (unsigned long)s_half_size,
+             (unsigned long)s_active, (unsigned long)s_seq, (long long)(esp_timer_get_time() - start));
+
+    if (!clean) {
+        // Don't append after a partially programmed record
+        return compact();
+    }
+    return ESP_OK;
+}
+
+/*── Devices ──*/
+
+const BridgeNvsStats &bridge_nvs_get_stats()
+{
+    return s_stats;
+}
+
+esp_err_t bridge_nvs_commit()
+{
+    // Appends are durable once written
+    return ESP_OK;
+}
+
+esp_err_t bridge_nvs_save_device(const BridgeDeviceState &device, bool commit)
+{
+    TraceScope trace(TRACE_ID_BRIDGE_NVS_SAVE);
+
+    if (device.device_id[0] == '\0') {
+        ESP_LOGE(TAG, "Invalid device_id: empty");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t buf[BridgeNvsDevice_size];
+    size_t len = bridge_nvs_encode_device(device, buf, sizeof(buf));
+    if (len == 0) {
+        return ESP_FAIL;
+    }
+
+    trace.set_arg(len);
+    uint32_t hash = bridge_hash_device_id(device.device_id);
+    if (live_full(hash)) {
+        ESP_LOGE(TAG, "Store holds %u devices - not saving '%s'", (unsigned)LIVE_CAPACITY, device.device_id);
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t offset;
+    esp_err_t err = append(RECORD_DEVICE, buf, static_cast<uint16_t>(len), &offset);
+    if (err != ESP_OK) {
+        return err;
+    }
+    set_live(hash, offset);
+
+    s_stats.writes++;
+    s_stats.payload_bytes += len;
+
+    DLOGI(TAG, "Saved device: %s (plug=%u, temp=%u, humidity=%u)",
+          device.device_id,
+          device.plug_endpoint_id, device.temp_endpoint_id, device.humidity_endpoint_id);
+    return ESP_OK;
+}
+
+std::optional<BridgeDeviceState> bridge_nvs_load_device(const char *device_id)
+{
+    uint16_t slot = find_live(bridge_hash_device_id(device_id));
+    if (slot == SlotIndex::NO_SLOT) {
+        return std::nullopt;
+    }
+
+    const RecordHeader *hdr = record_at(s_live[slot].offset);
+    auto device = bridge_nvs_decode_device(reinterpret_cast<const uint8_t *>(hdr + 1), hdr->len);
+    if (device.has_value() && strcmp(device->device_id, device_id) != 0) {
+        // Different id with the same hash
+        return std::nullopt;
+    }
+    return device;
+}
+
+esp_err_t bridge_nvs_delete_device(const char *device_id)
+{
+    uint16_t slot = find_live(bridge_hash_device_id(device_id));
+    if (slot == SlotIndex::NO_SLOT) {
+        return ESP_OK;  // Already gone
+    }
+
+    esp_err_t err = append(RECORD_DELETE, device_id, static_cast<uint16_t>(strlen(device_id)));
+    if (err != ESP_OK) {
+        return err;
+    }
+    remove_live(slot);     // Compaction keeps slot order
+
+    ESP_LOGI(TAG, "Deleted device: %s", device_id);
+    return ESP_OK;
+}
+
+std::vector<BridgeDeviceState> bridge_nvs_load_all_devices()
+{
+    std::vector<BridgeDeviceState> devices;
+    devices.reserve(s_live.size());
+
+    // Decode straight from the mapped partition
+    for (const LiveRecord &rec : s_live) {
+        const RecordHeader *hdr = record_at(rec.offset);
+        auto device = bridge_nvs_decode_device(reinterpret_cast<const uint8_t *>(hdr + 1), hdr->len);
+        if (device.has_value()) {
+            devices.push_back(std::move(device.value()));
+        } else {
+            ESP_LOGE(TAG, "Failed to decode record at offset %lu", (unsigned long)rec.offset);
+        }
+    }
+
+    ESP_LOGI(TAG, "Loaded %zu devices from store", devices.size());
+    return devices;
+}
+
+esp_err_t bridge_nvs_erase_all()
+{
+    esp_err_t err = format();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    ESP_LOGW(TAG, "Erased all bridge data from store");
+    return ESP_OK;
+}
+
+#endif // CONFIG_BRIDGE_STORE_LOG
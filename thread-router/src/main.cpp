@@ -1,12 +1,12 @@
-#include <cstring>
-
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 #include "esp_vfs_eventfd.h"
 #include "nvs_flash.h"
 
@@ -19,14 +19,18 @@ extern "C" {
 // Boot button GPIO (active low)
 #define BOOT_BUTTON_GPIO GPIO_NUM_0
 #define BOOT_BUTTON_HOLD_MS 3000
-#define BOOT_BUTTON_CHECK_DELAY_MS 1000
 
 #include <esp_matter.h>
 #include <esp_matter_core.h>
 #include <esp_matter_endpoint.h>
 #include <app/clusters/on-off-server/on-off-server.h>
 
+#include "alloc_counter.hpp"
+#include "bridge_diagnostics.hpp"
+#include "bridge_events.hpp"
 #include "bridge_state.hpp"
+#include "dlog.h"
+#include "event_trace.h"
 
 using namespace esp_matter;
 
@@ -34,20 +38,30 @@ static const char *TAG = "tr-router";
 
 #define PM_STATS_INTERVAL_MS 60000
 
-// Mutex for serializing access to bridge state
-static SemaphoreHandle_t s_bridge_mutex = nullptr;
-
-// Global bridge state manager
+// Global bridge state manager - owned by the bridge task once it starts
 static BridgeState g_bridge;
 
-// RAII lock guard (recursive mutex to allow nested locking)
-class BridgeLock {
-public:
-    BridgeLock() { if (s_bridge_mutex) xSemaphoreTakeRecursive(s_bridge_mutex, portMAX_DELAY); }
-    ~BridgeLock() { if (s_bridge_mutex) xSemaphoreGiveRecursive(s_bridge_mutex); }
-    BridgeLock(const BridgeLock&) = delete;
-    BridgeLock& operator=(const BridgeLock&) = delete;
-};
+// Inputs for the bridge task from the OpenThread and CHIP tasks, the boot
+// button and the shutdown handler
+static BridgeEventQueue s_events;
+static TaskHandle_t s_bridge_task = nullptr;
+
+// Cleared before erasing NVS so the shutdown flush doesn't write devices back
+// (bridge task only)
+static bool s_persist_enabled = true;
+
+// Boot phase timestamps (esp_timer us since boot, 0 = not reached yet)
+static struct {
+    int64_t matter_ready_us;
+    int64_t bridge_ready_us;    // Bridge task started (endpoints resume from here)
+    volatile int64_t thread_ready_us;
+    bool logged;                // Bridge task only
+} s_boot;
+
+#if CONFIG_BRIDGE_ALLOC_CHECK
+static ReportPathStats s_report_stats;          // Bridge task
+static volatile uint32_t s_callback_allocs = 0; // on_thread_message (OpenThread task)
+#endif
 
 // Matter attribute update callback
 static esp_err_t app_attribute_update_cb(attribute::callback_type_t type,
@@ -55,14 +69,27 @@ static esp_err_t app_attribute_update_cb(attribute::callback_type_t type,
                                          uint32_t attribute_id, esp_matter_attr_val_t *val,
                                          void *priv_data)
 {
+    if (type == attribute::PRE_UPDATE) {
+        TRACE_INSTANT(TRACE_ID_MATTER_WRITE, endpoint_id);
+    } else if (type == attribute::POST_UPDATE) {
+        bridge_matter_persist_record(endpoint_id, cluster_id, attribute_id);
+    }
+
     // Handle OnOff cluster commands from Matter controllers
-    // Skip if this update is from our own Thread report processing
+    // Skip the updates the bridge itself publishes from device reports
     if (type == attribute::PRE_UPDATE &&
         cluster_id == chip::app::Clusters::OnOff::Id &&
         attribute_id == chip::app::Clusters::OnOff::Attributes::OnOff::Id &&
-        !g_bridge.updating_from_thread) {
-        BridgeLock lock;
-        g_bridge.queue_cmd(endpoint_id, val->val.b);
+        !AttributePublisher::is_own_update(endpoint_id, cluster_id, attribute_id)) {
+        BridgeEvent event = {};
+        event.type = BridgeEventType::ON_OFF_WRITE;
+        event.write.endpoint_id = endpoint_id;
+        event.write.on = val->val.b;
+        if (!s_events.post(event)) {
+            // Reject the write rather than show a state the bridge never saw
+            ESP_LOGW(TAG, "Bridge event queue full - rejecting OnOff write on endpoint %u", endpoint_id);
+            return ESP_ERR_NO_MEM;
+        }
     }
 
     return ESP_OK;
@@ -78,54 +105,196 @@ static esp_err_t app_identification_cb(identification::callback_type_t type,
     return ESP_OK;
 }
 
-// Boot button task - monitors for factory reset gesture
-// Hold 3s = erase bridge data, hold 6s = full factory reset
-static void boot_button_task(void *arg)
+static void handle_report(const BridgeEvent &event)
 {
-    // Configure GPIO
-    gpio_set_direction(BOOT_BUTTON_GPIO, GPIO_MODE_INPUT);
-    gpio_set_pull_mode(BOOT_BUTTON_GPIO, GPIO_PULLUP_ONLY);
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    const thread_comms_report_t &report = event.report;
+    const BridgeDevice *dev = g_bridge.find_by_device_id(report.device_id);
+    bool steady = dev && dev->endpoints_live && !dev->resume_pending && !dev->provisioning;
+
+    AllocCounter allocs;
+    uint32_t start = esp_cpu_get_cycle_count();
+    g_bridge.on_report(event);
+    s_report_stats.cycles += esp_cpu_get_cycle_count() - start;
+
+    s_report_stats.reports++;
+    s_report_stats.allocs += allocs.count();
+    if (steady) {
+        s_report_stats.steady++;
+        if (allocs.count() > 0) {
+            s_report_stats.steady_allocating++;
+            DLOGW(TAG, "Report from '%s' allocated %lu times", report.device_id, (unsigned long)allocs.count());
+        }
+    }
+#else
+    g_bridge.on_report(event);
+#endif
+}
 
-    ESP_LOGI(TAG, "Boot button task started (GPIO%d)", BOOT_BUTTON_GPIO);
+#if CONFIG_BRIDGE_ALLOC_CHECK
+static void log_report_path_stats()
+{
+    const ReportPathStats &s = s_report_stats;
+    ESP_LOGI(TAG, "Report path: %lu reports, %lu cycles/report, %lu heap allocations (%lu in the Thread callback); "
+                  "%lu of %lu steady-state reports allocated",
+             (unsigned long)s.reports, (unsigned long)(s.reports ? s.cycles / s.reports : 0),
+             (unsigned long)s.allocs, (unsigned long)s_callback_allocs,
+             (unsigned long)s.steady_allocating, (unsigned long)s.steady);
+}
+#endif
 
-    for (;;) {
-        // Wait for button press
-        if (gpio_get_level(BOOT_BUTTON_GPIO) == 0) {
-            ESP_LOGW(TAG, "Boot button detected - hold 3s for bridge reset, 6s for factory reset...");
-            int held_ms = 0;
-            bool bridge_reset_logged = false;
+// Logged by the bridge task with the first report it handles
+static void log_boot_timeline(int64_t first_report_us)
+{
+    int64_t thread_ready_us = s_boot.thread_ready_us;
+    ESP_LOGI(TAG, "Boot: Matter ready %lld ms, bridge task %lld ms, Thread up %lld ms, first report %lld ms",
+             (long long)(s_boot.matter_ready_us / 1000), (long long)(s_boot.bridge_ready_us / 1000),
+             (long long)(thread_ready_us / 1000), (long long)(first_report_us / 1000));
+}
 
-            while (gpio_get_level(BOOT_BUTTON_GPIO) == 0) {
-                vTaskDelay(pdMS_TO_TICKS(100));
-                held_ms += 100;
+static void handle_event(const BridgeEvent &event)
+{
+    switch (event.type) {
+        case BridgeEventType::REPORT:
+            if (!s_boot.logged) {
+                s_boot.logged = true;
+                log_boot_timeline(event.posted_us);
+            }
+            handle_report(event);
+            break;
+        case BridgeEventType::ON_OFF_WRITE:
+            g_bridge.queue_cmd(event.write.endpoint_id, event.write.on);
+            break;
+        case BridgeEventType::PROVISIONED:
+            g_bridge.on_provisioned(event);
+            break;
+        case BridgeEventType::FLUSH:
+            if (s_persist_enabled) {
+                g_bridge.flush_dirty();
+            }
+            break;
+        case BridgeEventType::ERASE:
+            s_persist_enabled = false;
+            bridge_nvs_erase_all();
+            break;
+        case BridgeEventType::FACTORY_RESET:
+            s_persist_enabled = false;
+            nvs_flash_erase();
+            break;
+        case BridgeEventType::SYNC:
+            if (event.sync.device_id[0]) {
+                const BridgeDevice *dev = g_bridge.find_by_device_id(event.sync.device_id);
+                *event.sync.ready = dev && dev->endpoints_live && !dev->provisioning;
+            }
+            break;
+    }
+}
 
-                if (held_ms >= BOOT_BUTTON_HOLD_MS && !bridge_reset_logged) {
-                    ESP_LOGW(TAG, "3s - release now for bridge reset, keep holding for factory reset...");
-                    bridge_reset_logged = true;
-                }
+// Single owner of g_bridge: handles queued events in batches, then runs due
+// timers (relay reconciliation), resumes persisted endpoints after boot and
+// flushes sensor values write-behind
+static void bridge_task(void *arg)
+{
+    const int64_t flush_us = (CONFIG_BRIDGE_NVS_FLUSH_INTERVAL_S ? CONFIG_BRIDGE_NVS_FLUSH_INTERVAL_S : 60) * 1000000LL;
+    const int64_t stats_us = CONFIG_BRIDGE_PERSIST_STATS_INTERVAL_S * 1000000LL;
+    int64_t last_flush_us = esp_timer_get_time();
+    int64_t last_stats_us = last_flush_us;
+    bool resuming = true;
 
-                if (held_ms >= BOOT_BUTTON_HOLD_MS * 2) {
-                    // 6 seconds - full factory reset
-                    ESP_LOGW(TAG, "Factory reset - erasing all NVS...");
-                    nvs_flash_erase();
+    while (true) {
+        // While resuming, wait one tick so batches continue between events
+        TickType_t wait = resuming ? 1 : pdMS_TO_TICKS(CONFIG_BRIDGE_TIMER_TICK_MS);
+        s_events.drain(wait, CONFIG_BRIDGE_EVENT_BATCH, handle_event);
+
+        g_bridge.run_timers();
+
+        if (resuming) {
+            resuming = g_bridge.resume_batch(CONFIG_BRIDGE_RESUME_BATCH) > 0;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_flush_us >= flush_us) {
+            last_flush_us = now_us;
+            if (s_persist_enabled) {
+                g_bridge.flush_dirty();
+            }
+        }
+        if (stats_us > 0 && now_us - last_stats_us >= stats_us) {
+            last_stats_us = now_us;
+            g_bridge.log_persist_stats();
+            g_bridge.log_publish_stats();
+            g_bridge.log_command_stats();
+            g_bridge.log_latency_stats();
+            g_bridge.log_delivery_stats();
+            g_bridge.log_provision_stats();
+#if CONFIG_BRIDGE_ALLOC_CHECK
+            log_report_path_stats();
+#endif
+            s_events.log_stats();
+            thread_comms_log_stats();
+        }
+    }
+}
+
+// Flush pending sensor values on esp_restart()
+static void bridge_flush_on_shutdown()
+{
+    if (xTaskGetCurrentTaskHandle() == s_bridge_task) {
+        if (s_persist_enabled) {
+            g_bridge.flush_dirty();
+        }
+        return;
+    }
+    BridgeEvent event = {};
+    event.type = BridgeEventType::FLUSH;
+    if (!s_events.post_and_wait(event, pdMS_TO_TICKS(2000))) {
+        ESP_LOGW(TAG, "Shutdown flush timed out");
+    }
+}
+
+// Boot button handler - factory reset gesture (debounced by power_management)
+// Short press = dump event trace, hold 3s = erase bridge data, hold 6s = full factory reset
+static void on_boot_button(gpio_num_t gpio, pm_wake_event_t event, uint32_t held_ms)
+{
+    switch (event) {
+        case PM_WAKE_EVENT_PRESS:
+            ESP_LOGW(TAG, "Boot button detected - hold 3s for bridge reset, 6s for factory reset...");
+            break;
+
+        case PM_WAKE_EVENT_HELD:
+            if (held_ms >= BOOT_BUTTON_HOLD_MS * 2) {
+                // 6 seconds - full factory reset
+                ESP_LOGW(TAG, "Factory reset - erasing all NVS...");
+                BridgeEvent erase = {};
+                erase.type = BridgeEventType::FACTORY_RESET;
+                if (s_events.post_and_wait(erase, pdMS_TO_TICKS(5000))) {
                     ESP_LOGW(TAG, "All NVS erased. Restarting...");
-                    vTaskDelay(pdMS_TO_TICKS(500));
-                    esp_restart();
+                } else {
+                    ESP_LOGE(TAG, "Bridge task did not respond - restarting without erasing");
                 }
+                vTaskDelay(pdMS_TO_TICKS(500));
+                esp_restart();
             }
+            ESP_LOGW(TAG, "3s - release now for bridge reset, keep holding for factory reset...");
+            break;
 
-            // Button released - check what action to take
+        case PM_WAKE_EVENT_RELEASE:
             if (held_ms >= BOOT_BUTTON_HOLD_MS) {
                 ESP_LOGW(TAG, "Erasing bridge device data...");
-                bridge_nvs_erase_all();
-                ESP_LOGW(TAG, "Bridge data erased. Restarting...");
+                BridgeEvent erase = {};
+                erase.type = BridgeEventType::ERASE;
+                if (s_events.post_and_wait(erase, pdMS_TO_TICKS(5000))) {
+                    ESP_LOGW(TAG, "Bridge data erased. Restarting...");
+                } else {
+                    ESP_LOGE(TAG, "Bridge task did not respond - restarting without erasing");
+                }
                 vTaskDelay(pdMS_TO_TICKS(500));
                 esp_restart();
             } else {
-                ESP_LOGI(TAG, "Button released - cancelled");
+                ESP_LOGI(TAG, "Button released - dumping event trace");
+                trace_dump();
             }
-        }
-        vTaskDelay(pdMS_TO_TICKS(100));  // Poll interval
+            break;
     }
 }
 
@@ -136,30 +305,65 @@ static void on_thread_message(const thread_comms_message_t *msg)
         return;
     }
 
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    AllocCounter allocs;
+#endif
+
     const thread_comms_report_t *r = &msg->report;
-    ESP_LOGI(TAG, "Report from '%s': temp=%.1f humidity=%.1f%% relay=%s",
+    DLOGI(TAG, "Report from '%s': temp=%.1f humidity=%.1f%% relay=%s",
              r->device_id,
              r->has_temperature ? r->temperature : 0,
              r->has_humidity ? r->humidity : 0,
              r->has_relay_state ? (r->relay_state ? "ON" : "OFF") : "N/A");
 
-    BridgeLock lock;
-    g_bridge.on_report(r);
+    BridgeEvent event = {};
+    event.type = BridgeEventType::REPORT;
+    event.report = *r;
+    event.has_latency = msg->has_latency;
+    event.latency_us = msg->latency_us;
+    event.latency_error_us = msg->latency_error_us;
+    event.seq = msg->seq;
+    event.epoch = msg->epoch;
+    if (!s_events.post(event)) {
+        DLOGW(TAG, "Bridge event queue full - dropped report from '%s'", r->device_id);
+    }
+
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    s_callback_allocs = s_callback_allocs + allocs.count();
+#endif
+}
+
+// Brings up Thread while app_main starts Matter. Reports arriving before the
+// bridge task exists wait in the event queue.
+static void thread_up_task(void *arg)
+{
+    const thread_comms_config_t *config = static_cast<const thread_comms_config_t *>(arg);
+    ESP_ERROR_CHECK(thread_comms_init(config));
+    s_boot.thread_ready_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Thread comms initialized in %lld ms - ready for devices!",
+             (long long)(s_boot.thread_ready_us / 1000));
+    vTaskDelete(NULL);
 }
 
 extern "C" void app_main(void)
 {
-    char device_name[32];
+    static char device_name[32];    // Used by thread_up_task after app_main returns
     device_name_get(device_name, sizeof(device_name));
     ESP_LOGI(TAG, "Thread Router - %s", device_name);
 
-    /* Power management */
+    /* Power management (also watches the boot button for the factory reset gesture) */
     pm_config_t pm_cfg = {
+        .wake_gpios = { { .gpio = BOOT_BUTTON_GPIO, .active_low = true, .hold_ms = BOOT_BUTTON_HOLD_MS } },
+        .num_wake_gpios = 1,
         .stats_interval_ms = PM_STATS_INTERVAL_MS,
+        .wake_cb = on_boot_button,
         .light_sleep_enable = false,  /* Router must stay awake */
     };
     pm_init(&pm_cfg);
 
+    /* Deferred logging for the report/command path */
+    dlog_init();
+
     /* NVS */
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -168,16 +372,22 @@ extern "C" void app_main(void)
         nvs_flash_init();
     }
 
-    /* Bridge state mutex and NVS */
-    s_bridge_mutex = xSemaphoreCreateRecursiveMutex();
-    if (!s_bridge_mutex) {
-        ESP_LOGE(TAG, "Failed to create bridge mutex");
-        return;
-    }
+    /* Bridge event queue (before Matter can deliver writes) and NVS */
+    ESP_ERROR_CHECK(s_events.init(CONFIG_BRIDGE_EVENT_QUEUE_LEN));
     ESP_ERROR_CHECK(bridge_nvs_init());
 
-    /* Start boot button monitor task (checks for factory reset gesture) */
-    xTaskCreate(boot_button_task, "boot_btn", 2048, NULL, 5, NULL);
+#if CONFIG_BRIDGE_DIAGNOSTICS
+    /* Boot benchmarks: store/index ones run now, before devices are loaded */
+    BridgeDiagnosticsHooks diag = {};
+    diag.events = &s_events;
+    diag.on_message = on_thread_message;
+    diag.thread_ready_us = &s_boot.thread_ready_us;
+#if CONFIG_BRIDGE_ALLOC_CHECK
+    diag.report_stats = &s_report_stats;
+    diag.callback_allocs = &s_callback_allocs;
+#endif
+    bridge_diagnostics_start(diag);
+#endif
 
     /* ESP-IDF networking stack */
     esp_vfs_eventfd_config_t eventfd_config = { .max_fds = 3 };
@@ -194,6 +404,26 @@ extern "C" void app_main(void)
     esp_log_level_set("chip[DL]", ESP_LOG_WARN);
     esp_log_level_set("chip[SVR]", ESP_LOG_WARN);
 
+    /* Thread networking and comms, attached in parallel with Matter start.
+       Reports only need s_events, which is already initialized. */
+    thread_comms_set_callback(on_thread_message);
+
+    static thread_comms_config_t comms_cfg = {
+        .device_id = device_name,
+        .source = THREAD_COMMS_SOURCE_ROUTER,
+#if CONFIG_OPENTHREAD_RADIO_SPINEL_UART
+        .use_uart_rcp = true,
+        .uart = {
+            .port = 1,
+            .tx_pin = 18,
+            .rx_pin = 17,
+        },
+#else
+        .use_uart_rcp = false,
+#endif
+    };
+    xTaskCreate(thread_up_task, "thread_up", 6144, &comms_cfg, 3, NULL);
+
     /* Create Matter node */
     ESP_LOGI(TAG, "Creating Matter node...");
     node::config_t node_config;
@@ -218,37 +448,22 @@ extern "C" void app_main(void)
         ESP_LOGE(TAG, "Failed to start Matter: %d", err);
         return;
     }
-    ESP_LOGI(TAG, "Matter started - ready for commissioning!");
-
-    /* Initialize bridge state (after Matter starts) */
-    {
-        BridgeLock lock;
-        uint16_t aggregator_id = endpoint::get_id(aggregator);
-        err = g_bridge.init(node, aggregator_id);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to initialize bridge state: %s", esp_err_to_name(err));
-            return;
-        }
+    s_boot.matter_ready_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Matter started in %lld ms - ready for commissioning!", (long long)(s_boot.matter_ready_us / 1000));
+
+    /* Initialize bridge state (after Matter starts) - nothing else touches
+       g_bridge until the bridge task is created below */
+    uint16_t aggregator_id = endpoint::get_id(aggregator);
+    err = g_bridge.init(node, aggregator_id, s_events);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize bridge state: %s", esp_err_to_name(err));
+        return;
     }
     ESP_LOGI(TAG, "Bridge state initialized");
 
-    /* Thread networking and comms (after bridge is ready to receive callbacks) */
-    thread_comms_set_callback(on_thread_message);
-
-    thread_comms_config_t comms_cfg = {
-        .device_id = device_name,
-        .source = THREAD_COMMS_SOURCE_ROUTER,
-#if CONFIG_OPENTHREAD_RADIO_SPINEL_UART
-        .use_uart_rcp = true,
-        .uart = {
-            .port = 1,
-            .tx_pin = 18,
-            .rx_pin = 17,
-        },
-#else
-        .use_uart_rcp = false,
-#endif
-    };
-    ESP_ERROR_CHECK(thread_comms_init(&comms_cfg));
-    ESP_LOGI(TAG, "Thread comms initialized - ready for devices!");
+    /* Bridge task: owns g_bridge from here on. Endpoint resume continues
+       there in the background while Thread attaches. */
+    s_boot.bridge_ready_us = esp_timer_get_time();
+    xTaskCreate(bridge_task, "bridge", 6144, NULL, 4, &s_bridge_task);
+    esp_register_shutdown_handler(bridge_flush_on_shutdown);
 }
@@ -15,10 +15,11 @@ typedef struct _BridgeNvsGlobal {
     uint32_t next_endpoint_id; /* Monotonic counter for endpoint assignment */
 } BridgeNvsGlobal;
 
-/* Stored at key "tr-dev-{hex}" e.g. "tr-dev-a3f2"
+/* Stored at key "tr-dev-{hash}": FNV-1a of device_id as 8 hex digits, e.g. "tr-dev-5c2e91a0"
+ (older firmware used the 4-hex device_id suffix; migrated on load)
  Each Thread device can have up to 3 Matter endpoints (one per capability) */
 typedef struct _BridgeNvsDevice {
-    char device_id[18]; /* Full device name: "vivid-falcon-a3f2" */
+    char device_id[24]; /* Full device name: "vivid-falcon-a3f2" */
     /* Endpoint IDs for each capability (0 = not present)
  Field 2 was previously "endpoint_id" - kept for backward compat (maps to plug) */
     uint32_t plug_endpoint_id;
@@ -80,7 +81,7 @@ extern const pb_msgdesc_t BridgeNvsDevice_msg;
 
 /* Maximum encoded size of messages (where known) */
 #define BRIDGE_NVS_PB_H_MAX_SIZE                 BridgeNvsDevice_size
-#define BridgeNvsDevice_size                     49
+#define BridgeNvsDevice_size                     55
 #define BridgeNvsGlobal_size                     6
 
 #ifdef __cplusplus
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Handle to a SlabPool slot; the generation goes stale when the slot is freed
+struct SlabHandle {
+    uint16_t index = 0xFFFF;
+    uint16_t generation = 0;
+
+    bool valid() const { return index != 0xFFFF; }
+    bool operator==(const SlabHandle &o) const { return index == o.index && generation == o.generation; }
+};
+
+// Fixed-capacity object pool with stable addresses.
+// Storage is inline (no heap), alloc/free are O(1) through a free list of
+// slot indices, and slot indices stay valid for the object's lifetime so they
+// can be stored in indexes. Not thread safe - used from the bridge task only.
+template <typename T, uint16_t N>
+class SlabPool {
+public:
+    static_assert(N > 0 && N < 0xFFFF, "SlabPool capacity must fit a uint16_t index");
+
+    SlabPool()
+    {
+        for (uint16_t i = 0; i < N; i++) {
+            next_free_[i] = static_cast<uint16_t>(i + 1);
+            generation_[i] = 0;
+            in_use_[i] = false;
+        }
+        next_free_[N - 1] = NONE;
+        free_head_ = 0;
+    }
+
+    ~SlabPool()
+    {
+        for (uint16_t i = 0; i < N; i++) {
+            if (in_use_[i]) slot(i)->~T();
+        }
+    }
+
+    SlabPool(const SlabPool &) = delete;
+    SlabPool &operator=(const SlabPool &) = delete;
+
+    // Construct an object in a free slot; nullptr when full
+    template <typename... Args>
+    T *alloc(Args &&...args)
+    {
+        if (free_head_ == NONE) return nullptr;
+
+        uint16_t i = free_head_;
+        free_head_ = next_free_[i];
+        in_use_[i] = true;
+        size_++;
+        if (size_ > high_water_) high_water_ = size_;
+        return new (slot(i)) T(std::forward<Args>(args)...);
+    }
+
+    void free(T *obj)
+    {
+        uint16_t i = index_of(obj);
+        if (i == NONE || !in_use_[i]) return;
+
+        obj->~T();
+        in_use_[i] = false;
+        generation_[i]++;
+        next_free_[i] = free_head_;
+        free_head_ = i;
+        size_--;
+    }
+
+    // Generation-checked lookup; nullptr if the slot was freed (and maybe reused)
+    T *get(SlabHandle h)
+    {
+        if (h.index >= N || !in_use_[h.index] || generation_[h.index] != h.generation) return nullptr;
+        return slot(h.index);
+    }
+
+    SlabHandle handle_of(const T *obj) const
+    {
+        uint16_t i = index_of(obj);
+        if (i == NONE) return SlabHandle{};
+        return SlabHandle{i, generation_[i]};
+    }
+
+    // Slot index of an object in this pool (NONE if not from this pool)
+    uint16_t index_of(const T *obj) const
+    {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(obj);
+        if (p < storage_ || p >= storage_ + sizeof(storage_)) return NONE;
+        return static_cast<uint16_t>((p - storage_) / sizeof(T));
+    }
+
+    // Object at a slot index (must be in use)
+    T &at(uint16_t index) { return *slot(index); }
+    const T &at(uint16_t index) const { return *slot(index); }
+
+    uint16_t size() const { return size_; }
+    uint16_t high_water() const { return high_water_; }
+    static constexpr uint16_t capacity() { return N; }
+    static constexpr size_t storage_bytes() { return sizeof(T) * N; }
+
+    // Iteration over live objects (slot order)
+    class iterator {
+    public:
+        iterator(SlabPool *pool, uint16_t i) : pool_(pool), i_(i) { skip(); }
+        T &operator*() const { return pool_->at(i_); }
+        T *operator->() const { return &pool_->at(i_); }
+        iterator &operator++() { i_++; skip(); return *this; }
+        bool operator!=(const iterator &o) const { return i_ != o.i_; }
+    private:
+        void skip() { while (i_ < N && !pool_->in_use_[i_]) i_++; }
+        SlabPool *pool_;
+        uint16_t i_;
+    };
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, N); }
+
+    static constexpr uint16_t NONE = 0xFFFF;
+
+private:
+    T *slot(uint16_t i) { return std::launder(reinterpret_cast<T *>(storage_ + i * sizeof(T))); }
+    const T *slot(uint16_t i) const { return std::launder(reinterpret_cast<const T *>(storage_ + i * sizeof(T))); }
+
+    alignas(T) uint8_t storage_[sizeof(T) * N];
+    uint16_t next_free_[N];
+    uint16_t generation_[N];
+    bool in_use_[N];
+    uint16_t free_head_;
+    uint16_t size_ = 0;
+    uint16_t high_water_ = 0;
+};
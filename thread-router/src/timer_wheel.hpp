@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+
+// Hierarchical timer wheel over a fixed set of timer ids (0..N-1).
+// Three levels of 64 slots cover 64, 4096 and 262144 ticks; longer timers are
+// parked in the top level and re-placed when it cascades. Timers live on
+// intrusive doubly linked lists, so arm()/cancel() are O(1) and advance()
+// costs O(1) per tick plus the timers that fire or cascade.
+// Not thread safe - used from the bridge task only.
+template <uint16_t N>
+class TimerWheel {
+public:
+    static_assert(N > 0 && N < 0xFFFF, "TimerWheel ids must fit a uint16_t");
+
+    TimerWheel()
+    {
+        for (uint16_t i = 0; i < N; i++) {
+            where_[i] = DETACHED;
+        }
+        for (uint16_t i = 0; i < LISTS; i++) {
+            head_[i] = NONE;
+        }
+    }
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // (Re)arm a timer to fire after delay_ticks; 0 fires on the next advance()
+    void arm(uint16_t id, uint32_t delay_ticks)
+    {
+        cancel(id);
+        expires_[id] = now_ + delay_ticks;
+        insert(id);
+        armed_++;
+    }
+
+    void cancel(uint16_t id)
+    {
+        if (where_[id] == DETACHED) return;
+        unlink(id);
+        armed_--;
+    }
+
+    bool armed(uint16_t id) const { return where_[id] != DETACHED; }
+    uint32_t armed_count() const { return armed_; }
+    uint32_t now() const { return now_; }
+
+    // Run every tick up to and including `tick`, calling on_expire(id) for each
+    // timer that is due. The callback may re-arm or cancel any timer.
+    template <typename OnExpire>
+    void advance(uint32_t tick, OnExpire on_expire)
+    {
+        // Timers armed with no delay since the last call
+        run_slot(now_ & MASK, on_expire);
+
+        while (static_cast<int32_t>(tick - now_) > 0) {
+            now_++;
+            if ((now_ & MASK) == 0) {
+                if (((now_ >> BITS) & MASK) == 0) {
+                    cascade(2 * SLOTS + ((now_ >> (2 * BITS)) & MASK));
+                }
+                cascade(SLOTS + ((now_ >> BITS) & MASK));
+            }
+            run_slot(now_ & MASK, on_expire);
+        }
+    }
+
+private:
+    static constexpr uint32_t BITS = 6;
+    static constexpr uint32_t SLOTS = 1u << BITS;
+    static constexpr uint32_t MASK = SLOTS - 1;
+    static constexpr uint16_t LISTS = 3 * SLOTS + 1;    // Last list holds timers being expired
+    static constexpr uint16_t EXPIRING = 3 * SLOTS;
+    static constexpr uint16_t DETACHED = 0xFFFF;
+    static constexpr uint16_t NONE = 0xFFFF;
+
+    // Place a timer by its distance from now
+    void insert(uint16_t id)
+    {
+        uint32_t expires = expires_[id];
+        int32_t delta = static_cast<int32_t>(expires - now_);
+        uint16_t list;
+        if (delta < static_cast<int32_t>(SLOTS)) {
+            list = (delta <= 0 ? now_ : expires) & MASK;
+        } else if (delta < static_cast<int32_t>(SLOTS * SLOTS)) {
+            list = SLOTS + ((expires >> BITS) & MASK);
+        } else {
+            // Beyond the top level: park at its far end, re-placed on cascade
+            uint32_t parked = delta < static_cast<int32_t>(SLOTS * SLOTS * SLOTS) ? expires
+                                                                                  : now_ + SLOTS * SLOTS * SLOTS - 1;
+            list = 2 * SLOTS + ((parked >> (2 * BITS)) & MASK);
+        }
+        link(id, list);
+    }
+
+    void link(uint16_t id, uint16_t list)
+    {
+        where_[id] = list;
+        prev_[id] = NONE;
+        next_[id] = head_[list];
+        if (head_[list] != NONE) prev_[head_[list]] = id;
+        head_[list] = id;
+    }
+
+    void unlink(uint16_t id)
+    {
+        uint16_t list = where_[id];
+        if (prev_[id] != NONE) next_[prev_[id]] = next_[id];
+        else head_[list] = next_[id];
+        if (next_[id] != NONE) prev_[next_[id]] = prev_[id];
+        where_[id] = DETACHED;
+    }
+
+    // Move a list's timers to the list(s) matching their remaining time
+    void cascade(uint16_t list)
+    {
+        uint16_t id = head_[list];
+        head_[list] = NONE;
+        while (id != NONE) {
+            uint16_t next = next_[id];
+            insert(id);
+            id = next;
+        }
+    }
+
+    template <typename OnExpire>
+    void run_slot(uint16_t slot, OnExpire &on_expire)
+    {
+        if (head_[slot] == NONE) return;
+
+        // Move the slot to the expiring list so callbacks can arm/cancel freely
+        uint16_t id = head_[slot];
+        head_[slot] = NONE;
+        while (id != NONE) {
+            uint16_t next = next_[id];
+            link(id, EXPIRING);
+            id = next;
+        }
+
+        while ((id = head_[EXPIRING]) != NONE) {
+            unlink(id);
+            if (static_cast<int32_t>(expires_[id] - now_) > 0) {
+                insert(id);     // Parked long timer that isn't due yet
+                continue;
+            }
+            armed_--;
+            on_expire(id);
+        }
+    }
+
+    uint16_t head_[LISTS];
+    uint16_t next_[N];
+    uint16_t prev_[N];
+    uint16_t where_[N];     // List holding the timer, DETACHED if not armed
+    uint32_t expires_[N];   // Absolute tick
+    uint32_t now_ = 0;
+    uint32_t armed_ = 0;
+};
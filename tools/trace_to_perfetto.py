@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Convert event_trace dumps to Chrome trace JSON (open in ui.perfetto.dev).
+
+Input is any text containing the lines printed by trace_dump(), e.g. a
+captured `xmake monitor` log:
+
+    python3 tools/trace_to_perfetto.py monitor.log -o trace.json
+    python3 tools/trace_to_perfetto.py < monitor.log > trace.json
+
+Only the last TRACE-START..TRACE-STOP block in the input is converted.
+"""
+
+import argparse
+import json
+import re
+import sys
+
+TYPE_BEGIN, TYPE_END, TYPE_INSTANT, TYPE_COUNTER = range(4)
+
+RE_START = re.compile(r"TRACE-START (\d+) (-?\d+)")
+RE_NAME = re.compile(r"TRACE-NAME (\d+) (\S+)")
+RE_TASK = re.compile(r"TRACE-TASK (\d+) (\S+)")
+RE_EVENT = re.compile(r"TRACE (\d+) (\d+) (\d+) (\d+) (\d+) (\d+)")
+
+
+def parse(lines):
+    """Return (names, tasks, events) from the last complete dump block."""
+    block = None
+    for line in lines:
+        if RE_START.search(line):
+            block = {"names": {}, "tasks": {}, "events": []}
+        elif block is None:
+            continue
+        elif "TRACE-STOP" in line:
+            done = block
+            block = None
+            yield done
+        elif m := RE_NAME.search(line):
+            block["names"][int(m[1])] = m[2]
+        elif m := RE_TASK.search(line):
+            block["tasks"][int(m[1])] = m[2]
+        elif m := RE_EVENT.search(line):
+            block["events"].append(tuple(int(g) for g in m.groups()))
+
+
+def convert(dump):
+    names, tasks = dump["names"], dump["tasks"]
+    out = []
+
+    for tid, name in tasks.items():
+        out.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": tid, "args": {"name": name}})
+
+    # Timestamps are 32-bit microseconds; unwrap per core (events are in ring order)
+    last_ts = {}
+    wraps = {}
+    for core, ts, etype, eid, arg, tid in dump["events"]:
+        if core in last_ts and ts < last_ts[core]:
+            wraps[core] = wraps.get(core, 0) + 1
+        last_ts[core] = ts
+        ts += wraps.get(core, 0) << 32
+
+        name = names.get(eid, f"id{eid}")
+        ev = {"name": name, "ts": ts, "pid": 0, "tid": tid if tid else f"isr{core}", "args": {"arg": arg, "core": core}}
+        if etype == TYPE_BEGIN:
+            ev["ph"] = "B"
+        elif etype == TYPE_END:
+            ev["ph"] = "E"
+        elif etype == TYPE_INSTANT:
+            ev["ph"] = "i"
+            ev["s"] = "t"
+        elif etype == TYPE_COUNTER:
+            ev["ph"] = "C"
+            ev["args"] = {name: arg}
+        else:
+            continue
+        out.append(ev)
+
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", help="Log file (default: stdin)")
+    parser.add_argument("-o", "--output", help="Output JSON file (default: stdout)")
+    args = parser.parse_args()
+
+    src = open(args.input, errors="replace") if args.input else sys.stdin
+    dumps = list(parse(src))
+    if not dumps:
+        sys.exit("No complete TRACE-START..TRACE-STOP block found")
+
+    trace = convert(dumps[-1])
+    dst = open(args.output, "w") if args.output else sys.stdout
+    json.dump(trace, dst)
+    if args.output:
+        print(f"Wrote {len(trace['traceEvents'])} events to {args.output}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()